@@ -11,6 +11,11 @@ BitStream::BitStream()
     mCurrentByte = mStreamPosition = 0;
 }
 
+void BitStream::reserve(unsigned bytes)
+{
+    mBytes.reserve(bytes);
+}
+
 void BitStream::insert(unsigned value, char bits)
 {
     value <<= (sizeof(value) * BITS_IN_BYTE) - bits;
@@ -54,6 +59,12 @@ void BitStream::insert(void* data, unsigned length)
 {
     unsigned char* ptr = (unsigned char*)data;
 
+    if (mBitsLeft == BITS_IN_BYTE)
+    {
+        mBytes.insert(mBytes.end(), ptr, ptr + length);
+        return;
+    }
+
     while (length > 0)
     {
         insert(*ptr++);
@@ -61,6 +72,16 @@ void BitStream::insert(void* data, unsigned length)
     }
 }
 
+void BitStream::alignToByte()
+{
+    if (mBitsLeft < BITS_IN_BYTE)
+    {
+        mBytes.push_back(mCurrentByte);
+        mCurrentByte = 0;
+        mBitsLeft = BITS_IN_BYTE;
+    }
+}
+
 void BitStream::read_bytes(void* bytes_out, unsigned length)
 {
     unsigned char* ptr = (unsigned char*)bytes_out;
@@ -112,6 +133,16 @@ void BitStream::read_bits(unsigned char& bits_out, char bits)
     }
 }
 
+void BitStream::skip_bits(unsigned bits)
+{
+    unsigned bitCount = getBitCount();
+
+    mStreamPosition += bits;
+
+    if (mStreamPosition > bitCount)
+        mStreamPosition = bitCount;
+}
+
 std::string BitStream::getBinaryString()
 {
     char byte, bit;
@@ -10,12 +10,17 @@ public:
 
     BitStream();
 
+    void reserve(unsigned bytes);
+
     void insert(unsigned value, char bits);
     void insert(unsigned char byte);
     void insert(void* data, unsigned length);
 
+    void alignToByte();
+
     void read_bytes(void* bytes_out, unsigned length);
     void read_bits(unsigned char& bits_out, char bits);
+    void skip_bits(unsigned bits);
 
     std::string getBinaryString();
     std::string getHexString();
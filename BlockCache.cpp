@@ -0,0 +1,276 @@
+#include "BlockCache.h"
+#include <functional>
+
+BlockCache::BlockCache(unsigned long long byteBudget, unsigned shardCount) :
+    mBytes(0), mNextShard(0), mHits(0), mMisses(0), mEvictions(0)
+{
+    if (shardCount < 1)
+        shardCount = 1;
+
+    for (unsigned i = 0; i < shardCount; i++)
+        mShards.push_back(std::unique_ptr<Shard>(new Shard()));
+
+    mByteBudget = byteBudget;
+}
+
+BlockCache::BlockData BlockCache::getBlock(const std::string& file, void* data, unsigned length, unsigned block, int& status)
+{
+    BlockData cached = lookup(file, block);
+
+    if (cached)
+    {
+        status = COMPRESSOR_OK;
+        return cached;
+    }
+
+    BlockIndex index = getIndex(file, data, length, status);
+
+    if (!index)
+        return BlockData();
+
+    if (block >= index->size())
+    {
+        status = COMPRESSOR_BAD_BLOCK;
+        return BlockData();
+    }
+
+    // Decoded outside of the shard lock, two threads missing on the same block
+    // may both decode it and the last insert wins
+    Compressor compressor;
+    std::shared_ptr<std::vector<unsigned char> > decoded = std::make_shared<std::vector<unsigned char> >();
+
+    status = compressor.decompressBlock(data, length, (*index)[block], *decoded);
+
+    if (status != COMPRESSOR_OK)
+        return BlockData();
+
+    insert(file, block, decoded);
+    return decoded;
+}
+
+BlockCache::BlockData BlockCache::lookup(const std::string& file, unsigned block)
+{
+    Key key = { file, block };
+    Shard& shard = getShard(key);
+    std::lock_guard<std::mutex> guard(shard.lock);
+
+    EntryIndex::iterator found = shard.index.find(key);
+
+    if (found == shard.index.end())
+    {
+        mMisses++;
+        return BlockData();
+    }
+
+    shard.entries.splice(shard.entries.begin(), shard.entries, found->second);
+    mHits++;
+
+    return found->second->data;
+}
+
+void BlockCache::insert(const std::string& file, unsigned block, BlockData data)
+{
+    Key key = { file, block };
+    Shard& shard = getShard(key);
+
+    if (!data || data->size() > mByteBudget)
+        return;
+
+    {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        EntryIndex::iterator found = shard.index.find(key);
+
+        if (found != shard.index.end())
+        {
+            mBytes -= found->second->data->size();
+            shard.entries.erase(found->second);
+            shard.index.erase(found);
+        }
+
+        Entry entry = { key, data };
+        shard.entries.push_front(entry);
+        shard.index[key] = shard.entries.begin();
+        mBytes += data->size();
+    }
+
+    // Other shards are locked one at a time, never while holding this one
+    evict(&key);
+}
+
+void BlockCache::invalidate(const std::string& file)
+{
+    {
+        std::lock_guard<std::mutex> guard(mIndexLock);
+        std::unordered_map<std::string, IndexList::iterator>::iterator found = mIndexes.find(file);
+
+        if (found != mIndexes.end())
+        {
+            mBytes -= found->second->bytes;
+            mIndexList.erase(found->second);
+            mIndexes.erase(found);
+        }
+    }
+
+    for (unsigned i = 0; i < mShards.size(); i++)
+    {
+        Shard& shard = *mShards[i];
+        std::lock_guard<std::mutex> guard(shard.lock);
+
+        for (EntryList::iterator it = shard.entries.begin(); it != shard.entries.end();)
+        {
+            if (it->key.file != file)
+            {
+                ++it;
+                continue;
+            }
+
+            mBytes -= it->data->size();
+            shard.index.erase(it->key);
+            it = shard.entries.erase(it);
+        }
+    }
+}
+
+void BlockCache::clear()
+{
+    {
+        std::lock_guard<std::mutex> guard(mIndexLock);
+
+        for (IndexList::iterator it = mIndexList.begin(); it != mIndexList.end(); ++it)
+            mBytes -= it->bytes;
+
+        mIndexes.clear();
+        mIndexList.clear();
+    }
+
+    for (unsigned i = 0; i < mShards.size(); i++)
+    {
+        Shard& shard = *mShards[i];
+        std::lock_guard<std::mutex> guard(shard.lock);
+
+        for (EntryList::iterator it = shard.entries.begin(); it != shard.entries.end(); ++it)
+            mBytes -= it->data->size();
+
+        shard.index.clear();
+        shard.entries.clear();
+    }
+}
+
+unsigned long long BlockCache::getHits()
+{
+    return mHits;
+}
+
+unsigned long long BlockCache::getMisses()
+{
+    return mMisses;
+}
+
+unsigned long long BlockCache::getEvictions()
+{
+    return mEvictions;
+}
+
+unsigned long long BlockCache::getCachedBytes()
+{
+    return mBytes;
+}
+
+BlockCache::BlockIndex BlockCache::getIndex(const std::string& file, void* data, unsigned length, int& status)
+{
+    {
+        std::lock_guard<std::mutex> guard(mIndexLock);
+        std::unordered_map<std::string, IndexList::iterator>::iterator found = mIndexes.find(file);
+
+        if (found != mIndexes.end())
+        {
+            mIndexList.splice(mIndexList.begin(), mIndexList, found->second);
+            status = COMPRESSOR_OK;
+            return found->second->index;
+        }
+    }
+
+    // Built outside of the lock like the blocks, the first one stored wins
+    std::shared_ptr<std::vector<Compressor::BlockPosition> > index = std::make_shared<std::vector<Compressor::BlockPosition> >();
+    status = Compressor::indexBlocks(data, length, *index);
+
+    if (status != COMPRESSOR_OK)
+        return BlockIndex();
+
+    {
+        std::lock_guard<std::mutex> guard(mIndexLock);
+        std::unordered_map<std::string, IndexList::iterator>::iterator found = mIndexes.find(file);
+
+        if (found != mIndexes.end())
+            return found->second->index;
+
+        IndexEntry entry = { file, index, file.size() + index->size() * sizeof(Compressor::BlockPosition) };
+        mIndexList.push_front(entry);
+        mIndexes[file] = mIndexList.begin();
+        mBytes += entry.bytes;
+    }
+
+    // The caller keeps its reference, so the index is usable even if it's evicted
+    evict(0);
+    return index;
+}
+
+size_t BlockCache::KeyHash::operator()(const Key& key) const
+{
+    size_t hash = std::hash<std::string>()(key.file);
+    return hash ^ (std::hash<unsigned>()(key.block) + 0x9E3779B9 + (hash << 6) + (hash >> 2));
+}
+
+BlockCache::Shard& BlockCache::getShard(const Key& key)
+{
+    // Mix the high bits in so the shard choice doesn't correlate with the buckets
+    size_t hash = KeyHash()(key);
+    return *mShards[(hash ^ (hash >> 16)) % mShards.size()];
+}
+
+void BlockCache::evict(const Key* kept)
+{
+    // Takes the oldest block of each shard in turn, so the budget is shared
+    // without draining one shard ahead of the others. The block just inserted
+    // stays, insert already refused blocks larger than the whole budget. Indexes
+    // go last, a file without one has to be walked again on its next miss
+    while (mBytes > mByteBudget)
+    {
+        bool evicted = false;
+
+        for (unsigned i = 0; i < mShards.size() && mBytes > mByteBudget; i++)
+        {
+            Shard& shard = *mShards[mNextShard++ % mShards.size()];
+            std::lock_guard<std::mutex> guard(shard.lock);
+
+            if (shard.entries.empty() || (kept && shard.entries.back().key == *kept))
+                continue;
+
+            Entry& last = shard.entries.back();
+
+            mBytes -= last.data->size();
+            shard.index.erase(last.key);
+            shard.entries.pop_back();
+            mEvictions++;
+            evicted = true;
+        }
+
+        // Only the kept block is left, or other threads' inserts are in flight
+        // and will evict for themselves
+        if (!evicted && !evictIndex())
+            break;
+    }
+}
+
+bool BlockCache::evictIndex()
+{
+    std::lock_guard<std::mutex> guard(mIndexLock);
+
+    if (mIndexList.empty())
+        return false;
+
+    mBytes -= mIndexList.back().bytes;
+    mIndexes.erase(mIndexList.back().file);
+    mIndexList.pop_back();
+    return true;
+}
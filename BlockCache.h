@@ -0,0 +1,108 @@
+#ifndef BLOCKCACHE_H
+#define BLOCKCACHE_H
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Compressor.h"
+
+// Cache of decompressed blocks keyed by (file, block index). Blocks are spread
+// over shards, each one with its own lock and LRU list, so lookups from different
+// threads rarely contend. The byte budget covers all shards together: an insert
+// that goes over it evicts the oldest blocks of every shard in turn, so a block
+// larger than a shard's share can still be cached. Each file's block index is
+// kept too, so a miss decodes one block without walking the file. Indexes count
+// against the same budget (a BlockPosition per block plus the file name) and are
+// evicted least recently used first once no other block is left to evict.
+// Safe to share between threads.
+class BlockCache
+{
+public:
+
+    typedef std::shared_ptr<const std::vector<unsigned char> > BlockData;
+
+    BlockCache(unsigned long long byteBudget, unsigned shardCount = DefaultShardCount);
+
+    // Returns the cached block or decompresses it from data (the whole compressed
+    // file) and caches it. status receives a CompressorStatus, null on failure.
+    // file must keep naming the same data until it is invalidated
+    BlockData getBlock(const std::string& file, void* data, unsigned length, unsigned block, int& status);
+
+    BlockData lookup(const std::string& file, unsigned block);
+    void insert(const std::string& file, unsigned block, BlockData data);
+
+    void invalidate(const std::string& file);
+    void clear();
+
+    unsigned long long getHits();
+    unsigned long long getMisses();
+    unsigned long long getEvictions();
+    unsigned long long getCachedBytes();
+
+    static const unsigned DefaultShardCount = 16;
+
+private:
+
+    struct Key
+    {
+        std::string file;
+        unsigned block;
+
+        bool operator==(const Key& other) const { return block == other.block && file == other.file; }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const;
+    };
+
+    struct Entry
+    {
+        Key key;
+        BlockData data;
+    };
+
+    typedef std::shared_ptr<const std::vector<Compressor::BlockPosition> > BlockIndex;
+    typedef std::list<Entry> EntryList;
+    typedef std::unordered_map<Key, EntryList::iterator, KeyHash> EntryIndex;
+
+    struct IndexEntry
+    {
+        std::string file;
+        BlockIndex index;
+        unsigned long long bytes;
+    };
+
+    typedef std::list<IndexEntry> IndexList;
+
+    struct Shard
+    {
+        std::mutex lock;
+        EntryList entries;  // most recently used first
+        EntryIndex index;
+    };
+
+    std::vector<std::unique_ptr<Shard> > mShards;
+    unsigned long long mByteBudget;
+    std::atomic<unsigned long long> mBytes;
+    std::atomic<unsigned> mNextShard;
+
+    std::mutex mIndexLock;
+    IndexList mIndexList;  // most recently used first
+    std::unordered_map<std::string, IndexList::iterator> mIndexes;
+
+    std::atomic<unsigned long long> mHits;
+    std::atomic<unsigned long long> mMisses;
+    std::atomic<unsigned long long> mEvictions;
+
+    BlockIndex getIndex(const std::string& file, void* data, unsigned length, int& status);
+    Shard& getShard(const Key& key);
+    void evict(const Key* kept);
+    bool evictIndex();
+};
+
+#endif // BLOCKCACHE_H
@@ -1,12 +1,30 @@
 #include "Compressor.h"
 #include <algorithm>
+#include <cstring>
+#include <functional>
 #include <iostream>
+#include <thread>
 #include "BitStream.h"
+#include "TansCoder.h"
+
+// Medians of a few benchmark/EngineCostBenchmark.cpp runs (-O2, one x86-64
+// machine, so only the ratios between engines mean much). perBlock is the
+// measured block overhead less an estimate of the table reads, perTableByte
+// is an estimate
+const Compressor::EngineCost Compressor::EngineCosts[ENGINE_COUNT] =
+{
+    // perBlock, perSymbol, perLiteral, perTableByte
+    { 400.0, 2.3, 2.6, 2.0 },    // ENGINE_FIXED_WIDTH
+    { 25.0, 0.3, 0.0, 0.0 },     // ENGINE_STORED
+    { 5000.0, 3.2, 0.0, 2.0 }    // ENGINE_TANS
+};
 
 Compressor::Compressor()
 {
-    int endianTest = 1;
-    mIsLittleEndian = *(char*)(&endianTest) == 1;
+    mBlockSize = DefaultBlockSize;
+    mDecodeSpeedBias = 0;
+    mEngine = COMPRESSOR_ENGINE_AUTO;
+    memset(mTable, 0, sizeof(mTable));
 }
 
 int Compressor::reverseEndianess(int value)
@@ -23,24 +41,432 @@ int Compressor::reverseEndianess(int value)
     return newValue;
 }
 
-std::vector<unsigned char> Compressor::compress(void* data, unsigned length)
+int Compressor::compress(void* data, unsigned length, std::vector<unsigned char>& result)
+{
+    if (mBlockSize == 0)
+        return compressSingleBlock(data, length, result);
+
+    unsigned char* ptr = (unsigned char*)data;
+    int status;
+
+    result.clear();
+    beginStream(result);
+
+    do {
+        unsigned blockLength = std::min(length, mBlockSize);
+
+        status = compressBlock(ptr, blockLength, blockLength == length, result);
+
+        if (status != COMPRESSOR_OK)
+            return status;
+
+        ptr += blockLength;
+        length -= blockLength;
+    } while (length > 0);
+
+    return COMPRESSOR_OK;
+}
+
+int Compressor::decompress(void* data, unsigned length, std::vector<unsigned char>& result)
+{
+    unsigned size;
+    int status = getDecompressedSize(data, length, size);
+
+    if (status != COMPRESSOR_OK)
+        return status;
+
+    result.resize(size);
+    return decompress(data, length, result.data(), size, size);
+}
+
+int Compressor::decompress(void* data, unsigned length, unsigned char* out, unsigned capacity, unsigned& size)
+{
+    // The size comes from the headers alone, so a small buffer is refused before decoding
+    int status = getDecompressedSize(data, length, size);
+
+    if (status != COMPRESSOR_OK)
+        return status;
+
+    if (size > capacity)
+        return COMPRESSOR_OUTPUT_TOO_SMALL;
+
+    if (isBlockFormat(data, length))
+        return decompressBlocks(data, length, out, size);
+
+    return decompressSingleBlock(data, length, out, size);
+}
+
+void Compressor::beginStream(std::vector<unsigned char>& result)
+{
+    BitStream bs;
+
+    bs.insert(BlockFormatVersion, 24);
+    bs.insert(0U, 3);
+    bs.alignToByte();
+
+    std::vector<unsigned char> header = bs.getData();
+    result.insert(result.end(), header.begin(), header.end());
+
+    memset(mTable, 0, sizeof(mTable));
+}
+
+int Compressor::compressBlock(void* data, unsigned length, bool lastBlock, std::vector<unsigned char>& result)
+{
+    if (length > MaxBlockSize)
+        return COMPRESSOR_INPUT_TOO_LARGE;
+
+    mFrequency = getFrequency(data, length);
+
+    unsigned char* ptr = (unsigned char*)data;
+    unsigned codes[256];
+    unsigned literalCount = 0;
+    std::vector<unsigned char> patches;
+    unsigned i;
+
+    BlockPlan plan = planBlock(length);
+
+    if (plan.engine == ENGINE_STORED)
+    {
+        BitStream bs;
+
+        bs.insert(lastBlock ? 1U : 0U, 1);
+        bs.insert(length, 24);
+        bs.insert((unsigned)ENGINE_STORED, 2);
+        bs.insert(0U, 29);
+        bs.insert(data, length);
+
+        std::vector<unsigned char> block = bs.getData();
+        result.insert(result.end(), block.begin(), block.end());
+
+        return COMPRESSOR_OK;
+    }
+
+    if (plan.engine == ENGINE_TANS)
+    {
+        compressTansBlock(ptr, length, lastBlock, plan.width, result);
+        return COMPRESSOR_OK;
+    }
+
+    int bits = plan.width;
+    int tableMode = plan.tableMode;
+    unsigned slots = (1 << bits) - 1;
+    unsigned topCount = std::min((unsigned)mFrequency.size(), slots);
+
+    if (tableMode == TABLE_NEW)
+    {
+        for (i = 0; i < slots; i++)
+            mTable[i] = i < topCount ? mFrequency[i].character : 0;
+    }
+    else if (tableMode == TABLE_PATCH)
+    {
+        bool inTop[256] = {false};
+        bool inTable[256] = {false};
+        bool kept[256] = {false};
+        std::vector<unsigned char> missing;
+        unsigned next = 0;
+
+        for (i = 0; i < topCount; i++)
+            inTop[(unsigned char)mFrequency[i].character] = true;
+
+        for (i = 0; i < slots; i++)
+            inTable[mTable[i]] = true;
+
+        for (i = 0; i < topCount; i++)
+        {
+            if (!inTable[(unsigned char)mFrequency[i].character])
+                missing.push_back(mFrequency[i].character);
+        }
+
+        // Overwrite slots holding bytes that dropped out of the top set (or
+        // duplicates) with the bytes that entered it
+        for (i = 0; i < slots && next < missing.size(); i++)
+        {
+            if (inTop[mTable[i]] && !kept[mTable[i]])
+            {
+                kept[mTable[i]] = true;
+                continue;
+            }
+
+            mTable[i] = missing[next++];
+            patches.push_back(i);
+            patches.push_back(mTable[i]);
+        }
+    }
+
+    memset(codes, 0, sizeof(codes));
+
+    for (i = slots; i-- > 0;)
+        codes[mTable[i]] = i + 1;
+
+    for (i = 0; i < mFrequency.size(); i++)
+    {
+        if (codes[(unsigned char)mFrequency[i].character] == 0)
+            literalCount += mFrequency[i].count;
+    }
+
+    BitStream bs;
+
+    bs.insert(lastBlock ? 1U : 0U, 1);
+    bs.insert(length, 24);
+    bs.insert((unsigned)ENGINE_FIXED_WIDTH, 2);
+    bs.insert((unsigned)bits, 3);
+    bs.insert((unsigned)tableMode, 2);
+    bs.insert(literalCount, 24);
+
+    if (tableMode == TABLE_NEW)
+    {
+        for (i = 0; i < slots; i++)
+            bs.insert(mTable[i]);
+    }
+    else if (tableMode == TABLE_PATCH)
+    {
+        bs.insert((unsigned)patches.size() / 2, 7);
+
+        for (i = 0; i < patches.size(); i += 2)
+        {
+            bs.insert((unsigned)patches[i], 7);
+            bs.insert(patches[i + 1]);
+        }
+    }
+
+    for (i = 0; i < length; i++)
+        bs.insert(codes[ptr[i]], bits);
+
+    for (i = 0; i < length; i++)
+    {
+        if (codes[ptr[i]] == 0)
+            bs.insert(ptr[i]);
+    }
+
+    bs.alignToByte();
+
+    std::vector<unsigned char> block = bs.getData();
+    result.insert(result.end(), block.begin(), block.end());
+
+    return COMPRESSOR_OK;
+}
+
+void Compressor::compressTansBlock(unsigned char* data, unsigned length, bool lastBlock, unsigned tableLog, std::vector<unsigned char>& result)
+{
+    unsigned counts[256] = {0};
+    TansCoder coder;
+    BitStream body, bs;
+
+    for (unsigned i = 0; i < mFrequency.size(); i++)
+        counts[(unsigned char)mFrequency[i].character] = mFrequency[i].count;
+
+    coder.normalize(counts, length, tableLog);
+    coder.writeTable(body);
+    coder.encode(data, length, body);
+    body.alignToByte();
+
+    std::vector<unsigned char> bodyData = body.getData();
+
+    bs.insert(lastBlock ? 1U : 0U, 1);
+    bs.insert(length, 24);
+    bs.insert((unsigned)ENGINE_TANS, 2);
+    bs.insert(tableLog, 4);
+    bs.insert((unsigned)bodyData.size(), 25);
+
+    std::vector<unsigned char> header = bs.getData();
+    result.insert(result.end(), header.begin(), header.end());
+    result.insert(result.end(), bodyData.begin(), bodyData.end());
+}
+
+Compressor::BlockPlan Compressor::planBlock(unsigned length)
+{
+    static const int modeOrder[] = { TABLE_REUSE, TABLE_PATCH, TABLE_NEW };
+    std::vector<BlockPlan> candidates;
+    unsigned counts[256] = {0};
+    unsigned long long smallest;
+    unsigned i;
+
+    for (i = 0; i < mFrequency.size(); i++)
+        counts[(unsigned char)mFrequency[i].character] = mFrequency[i].count;
+
+    BlockPlan stored = { ENGINE_STORED, 0, 0, BlockHeaderBits + length * 8ULL, estimateDecodeCost(ENGINE_STORED, length, 0, 0) };
+    candidates.push_back(stored);
+
+    if (length > 0)
+    {
+        TansCoder coder;
+        unsigned tableLog = TansCoder::chooseTableLog(length, mFrequency.size());
+
+        coder.normalize(counts, length, tableLog);
+
+        unsigned tableBits = coder.getTableBits();
+        BlockPlan tans = { ENGINE_TANS, (int)tableLog, 0, 0, estimateDecodeCost(ENGINE_TANS, length, 0, (tableBits + 7) / 8) };
+
+        tans.bits = BlockHeaderBits + tableBits + (unsigned long long)coder.estimatePayloadBits(counts) + 1;
+        candidates.push_back(tans);
+    }
+
+    for (int bits = 1; bits <= 7; bits++)
+    {
+        unsigned slots = (1 << bits) - 1;
+        unsigned topCount = std::min((unsigned)mFrequency.size(), slots);
+        unsigned covered = 0, reused = 0, missing = 0;
+        bool inTable[256] = {false};
+
+        for (i = 0; i < slots; i++)
+        {
+            if (!inTable[mTable[i]])
+                reused += counts[mTable[i]];
+
+            inTable[mTable[i]] = true;
+        }
+
+        for (i = 0; i < topCount; i++)
+        {
+            covered += mFrequency[i].count;
+
+            if (!inTable[(unsigned char)mFrequency[i].character])
+                missing++;
+        }
+
+        unsigned long long codeBits = BlockHeaderBits + (unsigned long long)length * bits;
+
+        for (i = 0; i < 3; i++)
+        {
+            BlockPlan plan = { ENGINE_FIXED_WIDTH, bits, modeOrder[i], 0, 0 };
+            unsigned literals = length - (plan.tableMode == TABLE_REUSE ? reused : covered);
+            unsigned tableBits = 0;
+
+            if (plan.tableMode == TABLE_NEW)
+                tableBits = slots * 8;
+            else if (plan.tableMode == TABLE_PATCH)
+                tableBits = 7 + missing * 15;
+
+            plan.bits = codeBits + tableBits + literals * 8ULL;
+            plan.decodeCost = estimateDecodeCost(ENGINE_FIXED_WIDTH, length, literals, (tableBits + 7) / 8);
+
+            candidates.push_back(plan);
+        }
+    }
+
+    // A forced engine that can't encode this block (tANS on an empty one)
+    // falls back to whatever is smallest
+    bool anyAllowed = false;
+
+    for (i = 0; i < candidates.size(); i++)
+        anyAllowed = anyAllowed || isEngineAllowed(candidates[i].engine);
+
+    smallest = 0;
+
+    for (i = 0; i < candidates.size(); i++)
+    {
+        if ((!anyAllowed || isEngineAllowed(candidates[i].engine)) && (smallest == 0 || candidates[i].bits < smallest))
+            smallest = candidates[i].bits;
+    }
+
+    // Among the encodings within the size budget keep the cheapest to decode,
+    // with no bias that is simply the cheapest of the smallest ones
+    double budget = smallest * (1.0 + mDecodeSpeedBias);
+    const BlockPlan* best = 0;
+
+    for (i = 0; i < candidates.size(); i++)
+    {
+        const BlockPlan& plan = candidates[i];
+
+        if ((anyAllowed && !isEngineAllowed(plan.engine)) || plan.bits > budget)
+            continue;
+
+        if (!best || plan.decodeCost < best->decodeCost || (plan.decodeCost == best->decodeCost && plan.bits < best->bits))
+            best = &plan;
+    }
+
+    return *best;
+}
+
+bool Compressor::isEngineAllowed(unsigned engine)
 {
+    switch (mEngine)
+    {
+        case COMPRESSOR_ENGINE_FIXED_WIDTH: return engine == ENGINE_FIXED_WIDTH;
+        case COMPRESSOR_ENGINE_STORED: return engine == ENGINE_STORED;
+        case COMPRESSOR_ENGINE_TANS: return engine == ENGINE_TANS;
+        default: return true;
+    }
+}
+
+double Compressor::estimateDecodeCost(unsigned engine, unsigned length, unsigned literals, unsigned tableBytes)
+{
+    const EngineCost& cost = EngineCosts[engine];
+    return cost.perBlock + cost.perSymbol * length + cost.perLiteral * literals + cost.perTableByte * tableBytes;
+}
+
+void Compressor::setDecodeSpeedBias(double tolerance)
+{
+    mDecodeSpeedBias = tolerance > 0 ? tolerance : 0;
+}
+
+double Compressor::getDecodeSpeedBias()
+{
+    return mDecodeSpeedBias;
+}
+
+void Compressor::setEngine(int engine)
+{
+    mEngine = engine;
+}
+
+int Compressor::getEngine()
+{
+    return mEngine;
+}
+
+void Compressor::setBlockSize(unsigned blockSize)
+{
+    mBlockSize = blockSize > MaxBlockSize ? MaxBlockSize : blockSize;
+}
+
+unsigned Compressor::getBlockSize()
+{
+    return mBlockSize;
+}
+
+unsigned long long Compressor::getCompressBound(unsigned length)
+{
+    // The legacy encoder never picks anything worse than 1-bit codes with every byte escaped
+    if (mBlockSize == 0)
+        return (computeSize(1, length, 0) + 7) / 8;
+
+    unsigned long long blocks = length == 0 ? 1 : (length + (unsigned long long)mBlockSize - 1) / mBlockSize;
+    unsigned long long perBlock = BlockHeaderBits / 8 + 1;
+    unsigned long long perSymbolBits = 9;
+
+    // Otherwise nothing larger than a stored block is ever picked, only a forced
+    // engine can go past it
+    if (mEngine == COMPRESSOR_ENGINE_TANS)
+    {
+        perBlock += (256 * (1 + TansCoder::MaxTableLog) + TansCoder::States * TansCoder::MaxTableLog + 7) / 8;
+        perSymbolBits = TansCoder::MaxTableLog;
+    }
+    else if (mEngine == COMPRESSOR_ENGINE_FIXED_WIDTH && mDecodeSpeedBias > 0)
+    {
+        perBlock += TableSlots;
+        perSymbolBits = 7 + 8;
+    }
+
+    return StreamHeaderBytes + blocks * perBlock + (perSymbolBits * length + 7) / 8;
+}
+
+int Compressor::compressSingleBlock(void* data, unsigned length, std::vector<unsigned char>& result)
+{
+    if (length > MaxSingleBlockLength)
+        return COMPRESSOR_INPUT_TOO_LARGE;
+
     mFrequency = getFrequency(data, length);
     int bits = getBestRatio(length);
     char* ptr = (char*)data;
     int i;
 
-    if (bits == -1)
-        return std::vector<unsigned char>();
-
     BitStream bs;
 
     unsigned totalSize = 27 + ((1 << bits) - 1) * 8;
 
-    if (mIsLittleEndian)
-        bs.insert((int)length, 24);
-    else
-        bs.insert(reverseEndianess((int)length), 24);
+    // insert writes the value's bits MSB-first, the same on every host
+    bs.insert(length, 24);
 
     bs.insert(bits, 3);
 
@@ -77,104 +503,651 @@ std::vector<unsigned char> Compressor::compress(void* data, unsigned length)
         totalSize += 8;
     }
 
-    return bs.getData();
+    result = bs.getData();
+    return COMPRESSOR_OK;
 }
 
-std::vector<unsigned char> Compressor::decompress(void* data, unsigned length)
+int Compressor::decompressSingleBlock(void* data, unsigned length, unsigned char* out, unsigned size)
 {
-    BitStream bs;
-    bs.insert(data, length);
-    bs.read_bytes(&length, 3);
+    SingleBlockLayout layout;
+    unsigned char* ptr = (unsigned char*)data;
+    unsigned long long availableBits = length * 8ULL;
+    unsigned i;
 
-    if (!mIsLittleEndian)
-        length = (unsigned)reverseEndianess((int)length);
+    if (length < 4)
+        return COMPRESSOR_BAD_TABLE;
 
-    unsigned char bits;
-    bs.read_bits(bits, 3);
+    unsigned originalLength = ((unsigned)ptr[0] << 16) | ((unsigned)ptr[1] << 8) | ptr[2];
 
-    if (bits < 1 || bits > 7)
+    if (originalLength > size)
+        return COMPRESSOR_OUTPUT_TOO_SMALL;
+
+    layout.data = ptr;
+    layout.bits = ptr[3] >> 5;
+
+    if (layout.bits < 1 || layout.bits > 7)
+        return COMPRESSOR_INVALID_BIT_SIZE;
+
+    // Every code has the same width, so code i always sits at codesStart + i * bits
+    // and only the escapes need to be counted to locate their literals
+    layout.codesStart = 27 + ((1 << layout.bits) - 1) * 8;
+    layout.literalsStart = layout.codesStart + (unsigned long long)originalLength * layout.bits;
+
+    if (layout.codesStart > availableBits)
+        return COMPRESSOR_BAD_TABLE;
+
+    if (layout.literalsStart > availableBits)
+        return COMPRESSOR_BAD_CODES;
+
+    for (i = 0; i < (1U << layout.bits) - 1; i++)
+        layout.table[i] = readBitsAt(ptr, 27 + i * 8, 8);
+
+    unsigned threadCount = std::thread::hardware_concurrency();
+
+    if (threadCount > originalLength / ParallelDecodeChunk)
+        threadCount = originalLength / ParallelDecodeChunk;
+
+    if (threadCount < 1)
+        threadCount = 1;
+
+    std::vector<unsigned> chunkStart(threadCount + 1);
+    std::vector<unsigned> chunkEscapes(threadCount + 1, 0);
+    std::vector<std::thread> threads;
+
+    for (i = 0; i <= threadCount; i++)
+        chunkStart[i] = (unsigned)((unsigned long long)originalLength * i / threadCount);
+
+    // Reserved up front so push_back can't throw with a joinable thread in hand,
+    // a chunk whose thread can't be started is handled on this one
+    threads.reserve(threadCount);
+
+    for (i = 1; i < threadCount; i++)
     {
-        char bStr[4];
-        throw (std::string("Bit-size of enconding isn't valid: ") + std::string(itoa(bits, bStr, 10)));
+        try {
+            threads.push_back(std::thread(countEscapes, std::cref(layout), chunkStart[i], chunkStart[i + 1], &chunkEscapes[i + 1]));
+        } catch (...) {
+            countEscapes(layout, chunkStart[i], chunkStart[i + 1], &chunkEscapes[i + 1]);
+        }
     }
 
-    unsigned char byte;
-    int bitsRead = 27;
-    int i;
-    std::vector<char> charTable;
-    std::vector<char> compressedChars;
+    countEscapes(layout, chunkStart[0], chunkStart[1], &chunkEscapes[1]);
+
+    for (i = 0; i < threads.size(); i++)
+        threads[i].join();
+
+    // Prefix sum turns per-chunk counts into each chunk's first literal index
+    for (i = 1; i <= threadCount; i++)
+        chunkEscapes[i] += chunkEscapes[i - 1];
+
+    if (layout.literalsStart + chunkEscapes[threadCount] * 8ULL > availableBits)
+        return COMPRESSOR_BAD_LITERALS;
+
+    threads.clear();
+
+    for (i = 1; i < threadCount; i++)
+    {
+        try {
+            threads.push_back(std::thread(decodeCodes, std::cref(layout), chunkStart[i], chunkStart[i + 1], chunkEscapes[i], out));
+        } catch (...) {
+            decodeCodes(layout, chunkStart[i], chunkStart[i + 1], chunkEscapes[i], out);
+        }
+    }
+
+    decodeCodes(layout, chunkStart[0], chunkStart[1], chunkEscapes[0], out);
+
+    for (i = 0; i < threads.size(); i++)
+        threads[i].join();
 
-    for (i = 1; i <= (1 << bits) - 1; i++)
+    return COMPRESSOR_OK;
+}
+
+void Compressor::countEscapes(const SingleBlockLayout& layout, unsigned begin, unsigned end, unsigned* escapes)
+{
+    unsigned count = 0;
+
+    for (unsigned i = begin; i < end; i++)
     {
-        bs.read_bits(byte, 8);
-        charTable.push_back(byte);
-        bitsRead += 8;
+        if (readBitsAt(layout.data, layout.codesStart + (unsigned long long)i * layout.bits, layout.bits) == 0)
+            count++;
+    }
+
+    *escapes = count;
+}
 
-        if (!bs.canRead())
-            throw std::string ("Bad file for decompression [1]");
+void Compressor::decodeCodes(const SingleBlockLayout& layout, unsigned begin, unsigned end, unsigned firstLiteral, unsigned char* out)
+{
+    unsigned long long literal = layout.literalsStart + firstLiteral * 8ULL;
+
+    for (unsigned i = begin; i < end; i++)
+    {
+        unsigned code = readBitsAt(layout.data, layout.codesStart + (unsigned long long)i * layout.bits, layout.bits);
+
+        if (code == 0)
+        {
+            out[i] = readBitsAt(layout.data, literal, 8);
+            literal += 8;
+        }
+        else
+        {
+            out[i] = layout.table[code - 1];
+        }
     }
+}
+
+unsigned Compressor::readBitsAt(const unsigned char* data, unsigned long long position, unsigned bits)
+{
+    // bits <= 8, so the value spans at most two bytes
+    unsigned long long byteIndex = position >> 3;
+    unsigned bitIndex = position & 7;
+    unsigned window = data[byteIndex] << 8;
+
+    if (bitIndex + bits > 8)
+        window |= data[byteIndex + 1];
+
+    return (window >> (16 - bitIndex - bits)) & ((1 << bits) - 1);
+}
+
+int Compressor::decompressBlocks(void* data, unsigned length, unsigned char* out, unsigned size)
+{
+    unsigned char* ptr = (unsigned char*)data;
+    unsigned offset = StreamHeaderBytes;
+    unsigned position = 0;
+    BlockHeader header;
+    int status;
+
+    if (((ptr[0] << 16) | (ptr[1] << 8) | ptr[2]) != BlockFormatVersion)
+        return COMPRESSOR_BAD_BLOCK;
+
+    unsigned char table[TableSlots] = {0};
 
-    for (unsigned j = 1; j <= length; j++)
+    do {
+        status = parseBlockHeader(ptr, length, offset, header);
+
+        if (status != COMPRESSOR_OK)
+            return status;
+
+        if (header.length > size - position)
+            return COMPRESSOR_OUTPUT_TOO_SMALL;
+
+        status = decodeBlock(ptr + offset, header, table, out + position);
+
+        if (status != COMPRESSOR_OK)
+            return status;
+
+        position += header.length;
+        offset += header.byteSize;
+    } while (!header.lastBlock);
+
+    return COMPRESSOR_OK;
+}
+
+int Compressor::decompressBlock(void* data, unsigned length, unsigned block, std::vector<unsigned char>& result)
+{
+    unsigned char* ptr = (unsigned char*)data;
+    unsigned offset = StreamHeaderBytes;
+    BlockHeader header;
+    int status;
+
+    if (!isBlockFormat(data, length))
     {
-        bs.read_bits(byte, bits);
-        bitsRead += bits;
-        compressedChars.push_back(byte);
+        if (block != 0)
+            return COMPRESSOR_BAD_BLOCK;
 
-        if (!bs.canRead())
-            throw std::string ("Bad file for decompression [2]");
+        return decompress(data, length, result);
     }
 
-    std::vector<unsigned char> result(length, 0);
+    if (((ptr[0] << 16) | (ptr[1] << 8) | ptr[2]) != BlockFormatVersion)
+        return COMPRESSOR_BAD_BLOCK;
+
+    unsigned char table[TableSlots] = {0};
+
+    for (unsigned i = 0;; i++)
+    {
+        status = parseBlockHeader(ptr, length, offset, header);
+
+        if (status != COMPRESSOR_OK)
+            return status;
+
+        if (i == block)
+            break;
+
+        if (header.lastBlock)
+            return COMPRESSOR_BAD_BLOCK;
+
+        status = applyTable(ptr + offset, header, table);
+
+        if (status != COMPRESSOR_OK)
+            return status;
+
+        offset += header.byteSize;
+    }
+
+    result.resize(header.length);
+    return decodeBlock(ptr + offset, header, table, result.data());
+}
+
+int Compressor::indexBlocks(void* data, unsigned length, std::vector<BlockPosition>& index)
+{
+    unsigned char* ptr = (unsigned char*)data;
+    BlockPosition position;
+    BlockHeader header;
+    int status;
+
+    index.clear();
+    position.offset = 0;
+    memset(position.table, 0, sizeof(position.table));
 
-    for (i = 0; i < (int)compressedChars.size(); i++)
+    if (!isBlockFormat(data, length))
     {
-        if (compressedChars[i] == 0 || (unsigned char)compressedChars[i] > charTable.size())
+        index.push_back(position);
+        return COMPRESSOR_OK;
+    }
+
+    if (((ptr[0] << 16) | (ptr[1] << 8) | ptr[2]) != BlockFormatVersion)
+        return COMPRESSOR_BAD_BLOCK;
+
+    position.offset = StreamHeaderBytes;
+
+    do {
+        status = parseBlockHeader(ptr, length, position.offset, header);
+
+        if (status != COMPRESSOR_OK)
+            return status;
+
+        index.push_back(position);
+        status = applyTable(ptr + position.offset, header, position.table);
+
+        if (status != COMPRESSOR_OK)
+            return status;
+
+        position.offset += header.byteSize;
+    } while (!header.lastBlock);
+
+    return COMPRESSOR_OK;
+}
+
+int Compressor::decompressBlock(void* data, unsigned length, const BlockPosition& position, std::vector<unsigned char>& result)
+{
+    unsigned char* ptr = (unsigned char*)data;
+    unsigned char table[TableSlots];
+    BlockHeader header;
+    int status;
+
+    if (!isBlockFormat(data, length))
+    {
+        if (position.offset != 0)
+            return COMPRESSOR_BAD_BLOCK;
+
+        return decompress(data, length, result);
+    }
+
+    if (position.offset < StreamHeaderBytes)
+        return COMPRESSOR_BAD_BLOCK;
+
+    status = parseBlockHeader(ptr, length, position.offset, header);
+
+    if (status != COMPRESSOR_OK)
+        return status;
+
+    memcpy(table, position.table, sizeof(table));
+    result.resize(header.length);
+
+    return decodeBlock(ptr + position.offset, header, table, result.data());
+}
+
+int Compressor::getBlockCount(void* data, unsigned length, unsigned& count)
+{
+    unsigned char* ptr = (unsigned char*)data;
+    unsigned offset = StreamHeaderBytes;
+    BlockHeader header;
+    int status;
+
+    if (!isBlockFormat(data, length))
+    {
+        count = 1;
+        return COMPRESSOR_OK;
+    }
+
+    if (((ptr[0] << 16) | (ptr[1] << 8) | ptr[2]) != BlockFormatVersion)
+        return COMPRESSOR_BAD_BLOCK;
+
+    count = 0;
+
+    do {
+        status = parseBlockHeader(ptr, length, offset, header);
+
+        if (status != COMPRESSOR_OK)
+            return status;
+
+        offset += header.byteSize;
+        count++;
+    } while (!header.lastBlock);
+
+    return COMPRESSOR_OK;
+}
+
+int Compressor::applyTable(unsigned char* block, const BlockHeader& header, unsigned char* table)
+{
+    unsigned long long position = BlockHeaderBits;
+    unsigned i;
+
+    if (header.engine != ENGINE_FIXED_WIDTH)
+        return COMPRESSOR_OK;
+
+    if (header.tableMode == TABLE_NEW)
+    {
+        for (i = 0; i < (1U << header.width) - 1; i++)
+            table[i] = readBitsAt(block, position + i * 8, 8);
+    }
+    else if (header.tableMode == TABLE_PATCH)
+    {
+        position += 7;
+
+        for (i = 0; i < header.patchCount; i++, position += 15)
         {
-            if (!bs.canRead())
-                throw std::string ("Bad file for decompression [3]");
+            unsigned slot = readBitsAt(block, position, 7);
+
+            if (slot >= TableSlots)
+                return COMPRESSOR_BAD_TABLE;
 
-            bs.read_bits(result[i], 8);
-            bitsRead += 8;
+            table[slot] = readBitsAt(block, position + 7, 8);
         }
-        else
+    }
+
+    return COMPRESSOR_OK;
+}
+
+int Compressor::decodeBlock(unsigned char* block, const BlockHeader& header, unsigned char* table, unsigned char* out)
+{
+    unsigned long long position = BlockHeaderBits;
+    unsigned escapes = 0;
+    int status;
+
+    if (header.engine == ENGINE_STORED)
+    {
+        if (header.length > 0)
+            memcpy(out, block + BlockHeaderBits / 8, header.length);
+
+        return COMPRESSOR_OK;
+    }
+
+    if (header.engine == ENGINE_TANS)
+    {
+        TansCoder coder;
+        return coder.decode(block + BlockHeaderBits / 8, header.byteSize - BlockHeaderBits / 8, 0, header.tableLog, out, header.length);
+    }
+
+    status = applyTable(block, header, table);
+
+    if (status != COMPRESSOR_OK)
+        return status;
+
+    if (header.tableMode == TABLE_NEW)
+        position += ((1 << header.width) - 1) * 8;
+    else if (header.tableMode == TABLE_PATCH)
+        position += 7 + header.patchCount * 15;
+
+    // Same layout as a legacy file: fixed-width codes, then the escaped literals.
+    // parseBlockHeader checked that both fit in the block, so stopping at
+    // literalCount escapes keeps every read inside it
+    unsigned long long literal = position + (unsigned long long)header.length * header.width;
+
+    for (unsigned i = 0; i < header.length; i++, position += header.width)
+    {
+        unsigned code = readBitsAt(block, position, header.width);
+
+        if (code != 0)
         {
-            result[i] = charTable[compressedChars[i] - 1];
+            out[i] = table[code - 1];
+            continue;
         }
+
+        if (escapes++ == header.literalCount)
+            return COMPRESSOR_BAD_LITERALS;
+
+        out[i] = readBitsAt(block, literal, 8);
+        literal += 8;
     }
 
-    return result;
+    if (escapes != header.literalCount)
+        return COMPRESSOR_BAD_LITERALS;
+
+    return COMPRESSOR_OK;
+}
+
+bool Compressor::isBlockFormat(void* data, unsigned length)
+{
+    unsigned char* ptr = (unsigned char*)data;
+
+    // Legacy files never have a 0 bit-size, the block format sets it to 0 on purpose
+    return length >= StreamHeaderBytes && (ptr[3] >> 5) == 0;
+}
+
+int Compressor::parseBlockHeader(unsigned char* data, unsigned length, unsigned offset, BlockHeader& header)
+{
+    unsigned long long fields = 0;
+    unsigned long long bitSize = BlockHeaderBits;
+    int i;
+
+    if ((unsigned long long)offset + BlockHeaderBits / 8 > length)
+        return COMPRESSOR_BAD_BLOCK;
+
+    for (i = 0; i < (int)BlockHeaderBits / 8; i++)
+        fields = (fields << 8) | data[offset + i];
+
+    header.lastBlock = (fields >> 55) & 1;
+    header.length = (fields >> 31) & 0xFFFFFF;
+    header.engine = (fields >> 29) & 3;
+    header.width = (fields >> 26) & 7;
+    header.tableMode = (fields >> 24) & 3;
+    header.literalCount = fields & 0xFFFFFF;
+    header.patchCount = 0;
+    header.tableLog = 0;
+
+    if (header.engine == ENGINE_TANS)
+    {
+        // Table log and body size replace the width, table mode and literal count
+        header.tableLog = (fields >> 25) & 0xF;
+        bitSize += (fields & 0x1FFFFFF) * 8;
+
+        if (offset + bitSize / 8 > length)
+            return COMPRESSOR_BAD_CODES;
+
+        header.byteSize = bitSize / 8;
+        return COMPRESSOR_OK;
+    }
+
+    if (header.engine == ENGINE_STORED)
+    {
+        bitSize += header.length * 8ULL;
+
+        if (offset + bitSize / 8 > length)
+            return COMPRESSOR_BAD_CODES;
+
+        header.byteSize = bitSize / 8;
+        return COMPRESSOR_OK;
+    }
+
+    if (header.engine != ENGINE_FIXED_WIDTH)
+        return COMPRESSOR_UNKNOWN_ENGINE;
+
+    if (header.width < 1)
+        return COMPRESSOR_INVALID_BIT_SIZE;
+
+    if (header.literalCount > header.length)
+        return COMPRESSOR_BAD_LITERALS;
+
+    if (header.tableMode == TABLE_NEW)
+    {
+        bitSize += ((1 << header.width) - 1) * 8;
+    }
+    else if (header.tableMode == TABLE_PATCH)
+    {
+        if ((unsigned long long)offset + BlockHeaderBits / 8 + 1 > length)
+            return COMPRESSOR_BAD_TABLE;
+
+        header.patchCount = data[offset + BlockHeaderBits / 8] >> 1;
+        bitSize += 7 + header.patchCount * 15;
+    }
+    else if (header.tableMode != TABLE_REUSE)
+    {
+        return COMPRESSOR_BAD_TABLE;
+    }
+
+    bitSize += (unsigned long long)header.length * header.width + header.literalCount * 8ULL;
+
+    if (offset + (bitSize + 7) / 8 > length)
+        return COMPRESSOR_BAD_CODES;
+
+    header.byteSize = (bitSize + 7) / 8;
+    return COMPRESSOR_OK;
+}
+
+int Compressor::getDecompressedSize(void* data, unsigned length, unsigned& size)
+{
+    unsigned char* ptr = (unsigned char*)data;
+
+    if (length < 4)
+        return COMPRESSOR_BAD_TABLE;
+
+    if (isBlockFormat(data, length))
+    {
+        unsigned long long total = 0;
+        unsigned offset = StreamHeaderBytes;
+        BlockHeader header;
+        int status;
+
+        if (((ptr[0] << 16) | (ptr[1] << 8) | ptr[2]) != BlockFormatVersion)
+            return COMPRESSOR_BAD_BLOCK;
+
+        do {
+            status = parseBlockHeader(ptr, length, offset, header);
+
+            if (status != COMPRESSOR_OK)
+                return status;
+
+            total += header.length;
+            offset += header.byteSize;
+        } while (!header.lastBlock);
+
+        if (total > 0xFFFFFFFFULL)
+            return COMPRESSOR_INPUT_TOO_LARGE;
+
+        size = (unsigned)total;
+        return COMPRESSOR_OK;
+    }
+
+    unsigned bits = ptr[3] >> 5;
+
+    if (bits < 1 || bits > 7)
+        return COMPRESSOR_INVALID_BIT_SIZE;
+
+    size = ((unsigned)ptr[0] << 16) | ((unsigned)ptr[1] << 8) | ptr[2];
+    return COMPRESSOR_OK;
+}
+
+const char* Compressor::getStatusString(int status)
+{
+    switch (status)
+    {
+        case COMPRESSOR_OK: return "No error";
+        case COMPRESSOR_INPUT_TOO_LARGE: return "Input is larger than the length field allows";
+        case COMPRESSOR_INVALID_BIT_SIZE: return "Bit-size of encoding isn't valid";
+        case COMPRESSOR_BAD_TABLE: return "Bad file for decompression [1]";
+        case COMPRESSOR_BAD_CODES: return "Bad file for decompression [2]";
+        case COMPRESSOR_BAD_LITERALS: return "Bad file for decompression [3]";
+        case COMPRESSOR_BAD_BLOCK: return "Bad block header";
+        case COMPRESSOR_UNKNOWN_ENGINE: return "Block uses an unknown encoding engine";
+        case COMPRESSOR_OUTPUT_TOO_SMALL: return "Output buffer is too small";
+        default: return "Unknown error";
+    }
 }
 
 Compressor::FrequencyVector Compressor::getFrequency(void* data, unsigned length)
 {
-    char* ptr = (char*)data;
+    unsigned char* ptr = (unsigned char*)data;
+    unsigned threadCount = std::thread::hardware_concurrency();
+    unsigned counts[256] = {0};
     FrequencyVector freq;
 
-    while (length-- > 0)
+    if (threadCount > length / ParallelHistogramChunk)
+        threadCount = length / ParallelHistogramChunk;
+
+    if (threadCount > 1)
     {
-        getChar(freq, *ptr).count++;
-        ptr++;
+        std::vector<unsigned> threadCounts(threadCount * 256, 0);
+        std::vector<std::thread> threads;
+        unsigned chunk = length / threadCount;
+
+        // Reserved up front so push_back can't throw with a joinable thread in hand
+        threads.reserve(threadCount);
+
+        for (unsigned t = 0; t < threadCount; t++)
+        {
+            unsigned chunkLength = t + 1 == threadCount ? length - chunk * t : chunk;
+
+            // A chunk whose thread can't be started is counted on this one
+            try {
+                threads.push_back(std::thread(countBytes, ptr + chunk * t, chunkLength, &threadCounts[t * 256]));
+            } catch (...) {
+                countBytes(ptr + chunk * t, chunkLength, &threadCounts[t * 256]);
+            }
+        }
+
+        for (unsigned t = 0; t < threads.size(); t++)
+            threads[t].join();
+
+        for (unsigned t = 0; t < threadCount * 256; t++)
+            counts[t % 256] += threadCounts[t];
+    }
+    else
+    {
+        countBytes(ptr, length, counts);
+    }
+
+    for (int c = 0; c < 256; c++)
+    {
+        if (counts[c] == 0)
+            continue;
+
+        freq.push_back(FrequencyChar((char)c));
+        freq.back().count = counts[c];
     }
 
     std::sort(freq.begin(), freq.end(), Compressor::compareFreq);
     return freq;
 }
 
-bool Compressor::compareFreq(FrequencyChar a, FrequencyChar b)
+void Compressor::countBytes(const unsigned char* data, unsigned length, unsigned* counts)
 {
-    return a.count >= b.count;
-}
+    // Consecutive bytes go to different sub-histograms so runs of the same byte
+    // don't serialize on a single counter's store-to-load dependency
+    static_assert(HistogramLanes == 4, "countBytes is unrolled for 4 lanes");
 
-Compressor::FrequencyChar& Compressor::getChar(FrequencyVector& vec, char character)
-{
-    for (unsigned i = 0; i < vec.size(); i++)
+    unsigned lanes[HistogramLanes][256] = {{0}};
+    unsigned i = 0;
+
+    for (; i + HistogramLanes <= length; i += HistogramLanes)
     {
-        if (vec[i].character == character)
-            return vec[i];
+        lanes[0][data[i]]++;
+        lanes[1][data[i + 1]]++;
+        lanes[2][data[i + 2]]++;
+        lanes[3][data[i + 3]]++;
     }
 
-    vec.push_back(FrequencyChar(character));
-    return vec.back();
+    for (; i < length; i++)
+        lanes[0][data[i]]++;
+
+    for (int c = 0; c < 256; c++)
+        counts[c] = lanes[0][c] + lanes[1][c] + lanes[2][c] + lanes[3][c];
+}
+
+bool Compressor::compareFreq(FrequencyChar a, FrequencyChar b)
+{
+    if (a.count != b.count)
+        return a.count > b.count;
+
+    return (unsigned char)a.character < (unsigned char)b.character;
 }
 
 int Compressor::findChar(FrequencyVector& vec, char character, unsigned limit)
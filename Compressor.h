@@ -3,6 +3,27 @@
 
 #include <vector>
 
+enum CompressorStatus
+{
+    COMPRESSOR_OK = 0,
+    COMPRESSOR_INPUT_TOO_LARGE,
+    COMPRESSOR_INVALID_BIT_SIZE,
+    COMPRESSOR_BAD_TABLE,
+    COMPRESSOR_BAD_CODES,
+    COMPRESSOR_BAD_LITERALS,
+    COMPRESSOR_BAD_BLOCK,
+    COMPRESSOR_UNKNOWN_ENGINE,
+    COMPRESSOR_OUTPUT_TOO_SMALL
+};
+
+enum CompressorEngine
+{
+    COMPRESSOR_ENGINE_AUTO = 0,
+    COMPRESSOR_ENGINE_FIXED_WIDTH,
+    COMPRESSOR_ENGINE_STORED,
+    COMPRESSOR_ENGINE_TANS
+};
+
 class Compressor
 {
 public:
@@ -11,11 +32,125 @@ public:
 
     int reverseEndianess(int value);
 
-    std::vector<unsigned char> compress(void* data, unsigned length);
-    std::vector<unsigned char> decompress(void* data, unsigned length);
+    int compress(void* data, unsigned length, std::vector<unsigned char>& result);
+    int decompress(void* data, unsigned length, std::vector<unsigned char>& result);
+
+    // Decodes straight into out. size receives the decompressed size, which is
+    // read from the headers first so a short buffer fails before any decoding
+    int decompress(void* data, unsigned length, unsigned char* out, unsigned capacity, unsigned& size);
+
+    // Block format building blocks, compress() is beginStream() followed by
+    // compressBlock() for every mBlockSize bytes of input
+    void beginStream(std::vector<unsigned char>& result);
+    int compressBlock(void* data, unsigned length, bool lastBlock, std::vector<unsigned char>& result);
+
+    void setBlockSize(unsigned blockSize);
+    unsigned getBlockSize();
+
+    // Accepted size growth (0.05 = 5%) over the smallest encoding of a block in
+    // exchange for the cheapest one to decode
+    void setDecodeSpeedBias(double tolerance);
+    double getDecodeSpeedBias();
+
+    // Restricts blocks to one CompressorEngine, AUTO lets planBlock choose
+    void setEngine(int engine);
+    int getEngine();
+    unsigned long long getCompressBound(unsigned length);
+
+    // Random access to one block, earlier blocks are only walked for their tables.
+    // Legacy single-block files have exactly one block
+    int decompressBlock(void* data, unsigned length, unsigned block, std::vector<unsigned char>& result);
+    static int getBlockCount(void* data, unsigned length, unsigned& count);
+
+    static const unsigned TableSlots = 127;
+
+    // Where a block starts and the fixed-width table in effect before it, enough
+    // to decode the block without walking the ones in front of it
+    struct BlockPosition
+    {
+        unsigned offset;
+        unsigned char table[TableSlots];
+    };
+
+    // One position per block in a single walk of the file, so repeated random
+    // access doesn't cost a walk each. A legacy file gets one at offset 0
+    static int indexBlocks(void* data, unsigned length, std::vector<BlockPosition>& index);
+    int decompressBlock(void* data, unsigned length, const BlockPosition& position, std::vector<unsigned char>& result);
+
+    static int getDecompressedSize(void* data, unsigned length, unsigned& size);
+    static const char* getStatusString(int status);
+
+    static const unsigned MaxSingleBlockLength = 0xFFFFFF;
+    static const unsigned MaxBlockSize = 0xFFFFFF;
+    static const unsigned DefaultBlockSize = 1 << 16;
 
 private:
 
+    enum BlockEngine
+    {
+        ENGINE_FIXED_WIDTH = 0,
+        ENGINE_STORED,
+        ENGINE_TANS,
+        ENGINE_COUNT
+    };
+
+    enum TableMode
+    {
+        TABLE_NEW = 0,
+        TABLE_REUSE,
+        TABLE_PATCH
+    };
+
+    struct BlockHeader
+    {
+        bool lastBlock;
+        unsigned length;
+        unsigned engine;
+        unsigned width;
+        unsigned tableMode;
+        unsigned literalCount;
+        unsigned patchCount;
+        unsigned tableLog;
+        unsigned byteSize;
+    };
+
+    // Estimated decode time in nanoseconds for each part of a block
+    struct EngineCost
+    {
+        double perBlock;
+        double perSymbol;
+        double perLiteral;
+        double perTableByte;
+    };
+
+    struct BlockPlan
+    {
+        unsigned engine;
+        int width;          // table log for ENGINE_TANS
+        int tableMode;
+        unsigned long long bits;
+        double decodeCost;
+    };
+
+    static const EngineCost EngineCosts[ENGINE_COUNT];
+
+    static const unsigned BlockFormatVersion = 2;
+    static const unsigned StreamHeaderBytes = 4;
+    static const unsigned BlockHeaderBits = 56;
+
+    static const unsigned HistogramLanes = 4;
+    static const unsigned ParallelHistogramChunk = 1 << 20;
+    static const unsigned ParallelDecodeChunk = 1 << 18;
+
+    struct SingleBlockLayout
+    {
+        const unsigned char* data;
+        unsigned bits;
+        unsigned long long codesStart;
+        unsigned long long literalsStart;
+        unsigned char table[TableSlots];
+    };
+
     struct FrequencyChar
     {
         FrequencyChar() : character(0), count(0) {}
@@ -29,12 +164,31 @@ private:
 
     static bool compareFreq(FrequencyChar a, FrequencyChar b);
 
-    bool mIsLittleEndian;
+    unsigned mBlockSize;
+    double mDecodeSpeedBias;
+    int mEngine;
+    unsigned char mTable[TableSlots];   // encoder only, carried from block to block
+
+    int compressSingleBlock(void* data, unsigned length, std::vector<unsigned char>& result);
+    int decompressSingleBlock(void* data, unsigned length, unsigned char* out, unsigned size);
+    static void countEscapes(const SingleBlockLayout& layout, unsigned begin, unsigned end, unsigned* escapes);
+    static void decodeCodes(const SingleBlockLayout& layout, unsigned begin, unsigned end, unsigned firstLiteral, unsigned char* out);
+    static unsigned readBitsAt(const unsigned char* data, unsigned long long position, unsigned bits);
+    int decompressBlocks(void* data, unsigned length, unsigned char* out, unsigned size);
+    static int decodeBlock(unsigned char* block, const BlockHeader& header, unsigned char* table, unsigned char* out);
+    static int applyTable(unsigned char* block, const BlockHeader& header, unsigned char* table);
+    BlockPlan planBlock(unsigned length);
+    bool isEngineAllowed(unsigned engine);
+    void compressTansBlock(unsigned char* data, unsigned length, bool lastBlock, unsigned tableLog, std::vector<unsigned char>& result);
+    static double estimateDecodeCost(unsigned engine, unsigned length, unsigned literals, unsigned tableBytes);
+
+    static bool isBlockFormat(void* data, unsigned length);
+    static int parseBlockHeader(unsigned char* data, unsigned length, unsigned offset, BlockHeader& header);
 
-    FrequencyChar& getChar(FrequencyVector& vec, char character);
     int findChar(FrequencyVector& vec, char character, unsigned limit);
     FrequencyVector getFrequency(void* data, unsigned length);
-    unsigned computeSize(int numberOfBits, unsigned dataLength, unsigned compressCount);
+    static void countBytes(const unsigned char* data, unsigned length, unsigned* counts);
+    static unsigned computeSize(int numberOfBits, unsigned dataLength, unsigned compressCount);
     int getBestRatio(unsigned length);
 };
 
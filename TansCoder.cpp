@@ -0,0 +1,327 @@
+#include "TansCoder.h"
+#include <cmath>
+#include <cstring>
+#include "BitStream.h"
+#include "Compressor.h"
+
+static unsigned highestBit(unsigned value)
+{
+    unsigned bit = 0;
+
+    while (value >>= 1)
+        bit++;
+
+    return bit;
+}
+
+// MSB-first read of up to 25 bits, same bit order as BitStream. Bytes past
+// byteLength read as zero, the caller checks position against the limit
+static inline unsigned readBits(const unsigned char* data, unsigned byteLength, unsigned long long& position, unsigned bits)
+{
+    unsigned long long byteIndex = position >> 3;
+    unsigned window = 0;
+
+    if (bits == 0)
+        return 0;
+
+    if (byteIndex + 4 <= byteLength)
+    {
+        window = ((unsigned)data[byteIndex] << 24) | ((unsigned)data[byteIndex + 1] << 16) |
+                 ((unsigned)data[byteIndex + 2] << 8) | data[byteIndex + 3];
+    }
+    else
+    {
+        for (unsigned i = 0; i < 4; i++)
+            window = (window << 8) | (byteIndex + i < byteLength ? data[byteIndex + i] : 0);
+    }
+
+    unsigned value = (window << (position & 7)) >> (32 - bits);
+    position += bits;
+
+    return value;
+}
+
+TansCoder::TansCoder()
+{
+    mTableLog = DefaultTableLog;
+    memset(mNormalized, 0, sizeof(mNormalized));
+}
+
+void TansCoder::normalize(const unsigned* counts, unsigned length, unsigned tableLog)
+{
+    unsigned tableSize = 1 << tableLog;
+    unsigned largest = 0;
+    unsigned total = 0;
+    int s;
+
+    mTableLog = tableLog;
+
+    for (s = 0; s < 256; s++)
+    {
+        mNormalized[s] = 0;
+
+        if (counts[s] == 0)
+            continue;
+
+        mNormalized[s] = (unsigned)((unsigned long long)counts[s] * tableSize / length);
+
+        if (mNormalized[s] == 0)
+            mNormalized[s] = 1;
+
+        if (mNormalized[s] > mNormalized[largest])
+            largest = s;
+
+        total += mNormalized[s];
+    }
+
+    if (total == 0)
+        return;
+
+    // Rounding leaves the sum off by a little, the most frequent byte absorbs it
+    // unless that would push it to zero, then the largest ones give a slot each
+    if (total <= tableSize || mNormalized[largest] > total - tableSize)
+    {
+        mNormalized[largest] = mNormalized[largest] + tableSize - total;
+        return;
+    }
+
+    while (total > tableSize)
+    {
+        largest = 0;
+
+        for (s = 0; s < 256; s++)
+        {
+            if (mNormalized[s] > mNormalized[largest])
+                largest = s;
+        }
+
+        mNormalized[largest]--;
+        total--;
+    }
+}
+
+unsigned TansCoder::chooseTableLog(unsigned length, unsigned distinct)
+{
+    unsigned tableLog = DefaultTableLog;
+
+    while (tableLog > MinTableLog && (1U << (tableLog - 1)) >= length && (1U << (tableLog - 1)) >= distinct)
+        tableLog--;
+
+    return tableLog;
+}
+
+double TansCoder::estimatePayloadBits(const unsigned* counts)
+{
+    double bits = States * mTableLog;
+
+    for (int s = 0; s < 256; s++)
+    {
+        if (counts[s] > 0)
+            bits += counts[s] * (mTableLog - std::log2((double)mNormalized[s]));
+    }
+
+    return bits;
+}
+
+unsigned TansCoder::getTableBits()
+{
+    unsigned bits = 256;
+
+    for (int s = 0; s < 256; s++)
+    {
+        if (mNormalized[s] > 0)
+            bits += mTableLog;
+    }
+
+    return bits;
+}
+
+unsigned TansCoder::getTableLog()
+{
+    return mTableLog;
+}
+
+void TansCoder::writeTable(BitStream& bs)
+{
+    for (int s = 0; s < 256; s++)
+    {
+        bs.insert(mNormalized[s] > 0 ? 1U : 0U, 1);
+
+        if (mNormalized[s] > 0)
+            bs.insert(mNormalized[s] - 1, mTableLog);
+    }
+}
+
+void TansCoder::encode(const unsigned char* data, unsigned length, BitStream& bs)
+{
+    unsigned tableSize = 1 << mTableLog;
+    std::vector<unsigned short> stateTable;
+    std::vector<unsigned> emitted(length);
+    unsigned symbolStart[256];
+    unsigned maxBits[256];
+    unsigned states[States];
+    unsigned i;
+
+    buildEncodeTable(stateTable, symbolStart);
+
+    for (i = 0; i < 256; i++)
+        maxBits[i] = mNormalized[i] > 0 ? mTableLog - highestBit(mNormalized[i]) : 0;
+
+    for (i = 0; i < States; i++)
+        states[i] = tableSize;
+
+    // ANS is last in, first out: encode backwards so the decoder runs forwards,
+    // keeping the bits of each symbol to write them out in forward order
+    for (i = length; i-- > 0;)
+    {
+        unsigned symbol = data[i];
+        unsigned state = states[i % States];
+        unsigned bits = maxBits[symbol];
+
+        if ((state >> bits) < mNormalized[symbol])
+            bits--;
+
+        emitted[i] = ((state & ((1 << bits) - 1)) << 4) | bits;
+        states[i % States] = stateTable[symbolStart[symbol] + (state >> bits) - mNormalized[symbol]];
+    }
+
+    for (i = 0; i < States; i++)
+        bs.insert(states[i] - tableSize, mTableLog);
+
+    for (i = 0; i < length; i++)
+    {
+        if (emitted[i] & 15)
+            bs.insert(emitted[i] >> 4, emitted[i] & 15);
+    }
+}
+
+int TansCoder::decode(const unsigned char* data, unsigned byteLength, unsigned long long position,
+                      unsigned tableLog, unsigned char* out, unsigned length)
+{
+    unsigned long long limit = byteLength * 8ULL;
+    unsigned tableSize = 1 << tableLog;
+    std::vector<DecodeEntry> table;
+    unsigned states[States];
+    unsigned total = 0;
+    unsigned i;
+
+    if (tableLog < MinTableLog || tableLog > MaxTableLog)
+        return COMPRESSOR_BAD_TABLE;
+
+    mTableLog = tableLog;
+
+    for (i = 0; i < 256; i++)
+    {
+        mNormalized[i] = readBits(data, byteLength, position, 1) ? readBits(data, byteLength, position, tableLog) + 1 : 0;
+        total += mNormalized[i];
+    }
+
+    if (total != tableSize || position > limit)
+        return COMPRESSOR_BAD_TABLE;
+
+    buildDecodeTable(table);
+
+    for (i = 0; i < States; i++)
+        states[i] = readBits(data, byteLength, position, tableLog);
+
+    const DecodeEntry* entries = table.data();
+
+    static_assert(States == 4, "decode is unrolled for 4 states");
+
+    for (i = 0; i + States <= length; i += States)
+    {
+        const DecodeEntry& e0 = entries[states[0]];
+        const DecodeEntry& e1 = entries[states[1]];
+        const DecodeEntry& e2 = entries[states[2]];
+        const DecodeEntry& e3 = entries[states[3]];
+
+        out[i] = e0.symbol;
+        out[i + 1] = e1.symbol;
+        out[i + 2] = e2.symbol;
+        out[i + 3] = e3.symbol;
+
+        states[0] = e0.newStateBase + readBits(data, byteLength, position, e0.bits);
+        states[1] = e1.newStateBase + readBits(data, byteLength, position, e1.bits);
+        states[2] = e2.newStateBase + readBits(data, byteLength, position, e2.bits);
+        states[3] = e3.newStateBase + readBits(data, byteLength, position, e3.bits);
+    }
+
+    for (; i < length; i++)
+    {
+        const DecodeEntry& entry = entries[states[i % States]];
+
+        out[i] = entry.symbol;
+        states[i % States] = entry.newStateBase + readBits(data, byteLength, position, entry.bits);
+    }
+
+    if (position > limit)
+        return COMPRESSOR_BAD_CODES;
+
+    return COMPRESSOR_OK;
+}
+
+std::vector<unsigned char> TansCoder::spreadSymbols()
+{
+    unsigned tableSize = 1 << mTableLog;
+    unsigned step = (tableSize >> 1) + (tableSize >> 3) + 3;
+    std::vector<unsigned char> spread(tableSize);
+    unsigned position = 0;
+
+    // step is odd, so it visits every slot of the power-of-two table exactly once
+    for (unsigned s = 0; s < 256; s++)
+    {
+        for (unsigned n = 0; n < mNormalized[s]; n++)
+        {
+            spread[position] = s;
+            position = (position + step) & (tableSize - 1);
+        }
+    }
+
+    return spread;
+}
+
+void TansCoder::buildDecodeTable(std::vector<DecodeEntry>& table)
+{
+    unsigned tableSize = 1 << mTableLog;
+    std::vector<unsigned char> spread = spreadSymbols();
+    unsigned next[256];
+
+    memcpy(next, mNormalized, sizeof(next));
+    table.resize(tableSize);
+
+    for (unsigned u = 0; u < tableSize; u++)
+    {
+        unsigned symbol = spread[u];
+        unsigned x = next[symbol]++;
+        unsigned bits = mTableLog - highestBit(x);
+
+        table[u].symbol = symbol;
+        table[u].bits = bits;
+        table[u].newStateBase = (x << bits) - tableSize;
+    }
+}
+
+void TansCoder::buildEncodeTable(std::vector<unsigned short>& stateTable, unsigned* symbolStart)
+{
+    unsigned tableSize = 1 << mTableLog;
+    std::vector<unsigned char> spread = spreadSymbols();
+    unsigned next[256];
+    unsigned start = 0;
+
+    for (unsigned s = 0; s < 256; s++)
+    {
+        symbolStart[s] = start;
+        start += mNormalized[s];
+    }
+
+    memcpy(next, mNormalized, sizeof(next));
+    stateTable.resize(tableSize);
+
+    for (unsigned u = 0; u < tableSize; u++)
+    {
+        unsigned symbol = spread[u];
+        unsigned x = next[symbol]++;
+
+        stateTable[symbolStart[symbol] + x - mNormalized[symbol]] = tableSize + u;
+    }
+}
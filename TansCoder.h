@@ -0,0 +1,57 @@
+#ifndef TANSCODER_H
+#define TANSCODER_H
+
+#include <vector>
+
+class BitStream;
+
+// Table-based asymmetric numeral system coder (FSE style). The histogram is
+// normalized to a power-of-two table and the symbols are spread across
+// States interleaved coders, so symbol i belongs to coder i % States and the
+// decoder's table lookups for neighbouring symbols don't depend on each other.
+class TansCoder
+{
+public:
+
+    TansCoder();
+
+    // Scales counts (256 entries summing to length) to 1 << tableLog slots,
+    // every byte that appears keeps at least one slot
+    void normalize(const unsigned* counts, unsigned length, unsigned tableLog);
+
+    static unsigned chooseTableLog(unsigned length, unsigned distinct);
+    double estimatePayloadBits(const unsigned* counts);
+    unsigned getTableBits();
+    unsigned getTableLog();
+
+    void writeTable(BitStream& bs);
+    void encode(const unsigned char* data, unsigned length, BitStream& bs);
+
+    // Reads the table and payload starting at bit position of data, never
+    // reading past byteLength. Returns a CompressorStatus
+    int decode(const unsigned char* data, unsigned byteLength, unsigned long long position,
+               unsigned tableLog, unsigned char* out, unsigned length);
+
+    static const unsigned States = 4;
+    static const unsigned MinTableLog = 5;
+    static const unsigned MaxTableLog = 12;
+    static const unsigned DefaultTableLog = 11;
+
+private:
+
+    struct DecodeEntry
+    {
+        unsigned short newStateBase;
+        unsigned char symbol;
+        unsigned char bits;
+    };
+
+    unsigned mTableLog;
+    unsigned mNormalized[256];
+
+    std::vector<unsigned char> spreadSymbols();
+    void buildDecodeTable(std::vector<DecodeEntry>& table);
+    void buildEncodeTable(std::vector<unsigned short>& stateTable, unsigned* symbolStart);
+};
+
+#endif // TANSCODER_H
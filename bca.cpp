@@ -0,0 +1,459 @@
+#include "bca.h"
+#include <cstring>
+#include <new>
+#include <vector>
+#include "BlockCache.h"
+#include "Compressor.h"
+
+enum StreamState
+{
+    STREAM_IDLE,
+    STREAM_WRITING,
+    STREAM_FINISHED
+};
+
+struct bca_context
+{
+    bca_context() : mode(BCA_MODE_COMPRESS), state(STREAM_IDLE), outputPosition(0) {}
+
+    Compressor compressor;
+
+    int mode;
+    StreamState state;
+    std::vector<unsigned char> input;
+    std::vector<unsigned char> output;
+    size_t outputPosition;
+};
+
+struct bca_cache
+{
+    bca_cache(unsigned long long byteBudget) : cache(byteBudget) {}
+
+    BlockCache cache;
+};
+
+static int toStatus(int compressorStatus)
+{
+    switch (compressorStatus)
+    {
+        case COMPRESSOR_OK: return BCA_OK;
+        case COMPRESSOR_INPUT_TOO_LARGE: return BCA_ERROR_INPUT_TOO_LARGE;
+        case COMPRESSOR_INVALID_BIT_SIZE: return BCA_ERROR_INVALID_BIT_SIZE;
+        case COMPRESSOR_BAD_TABLE: return BCA_ERROR_BAD_TABLE;
+        case COMPRESSOR_BAD_CODES: return BCA_ERROR_BAD_CODES;
+        case COMPRESSOR_BAD_LITERALS: return BCA_ERROR_BAD_LITERALS;
+        case COMPRESSOR_BAD_BLOCK: return BCA_ERROR_BAD_BLOCK;
+        case COMPRESSOR_UNKNOWN_ENGINE: return BCA_ERROR_UNKNOWN_ENGINE;
+        case COMPRESSOR_OUTPUT_TOO_SMALL: return BCA_ERROR_OUTPUT_TOO_SMALL;
+        default: return BCA_ERROR_UNKNOWN;
+    }
+}
+
+static int copyOut(const std::vector<unsigned char>& data, void* dst, size_t dstCapacity, size_t* dstLength)
+{
+    *dstLength = data.size();
+
+    if (data.size() > dstCapacity)
+        return BCA_ERROR_OUTPUT_TOO_SMALL;
+
+    if (!data.empty())
+        memcpy(dst, data.data(), data.size());
+
+    return BCA_OK;
+}
+
+static int runCodec(bca_context* ctx, int mode, const void* src, size_t srcLength, std::vector<unsigned char>& result)
+{
+    if (srcLength > 0xFFFFFFFFu)
+        return BCA_ERROR_INPUT_TOO_LARGE;
+
+    try {
+        if (mode == BCA_MODE_COMPRESS)
+            return toStatus(ctx->compressor.compress((void*)src, (unsigned)srcLength, result));
+        else
+            return toStatus(ctx->compressor.decompress((void*)src, (unsigned)srcLength, result));
+    } catch (std::bad_alloc&) {
+        return BCA_ERROR_OUT_OF_MEMORY;
+    } catch (...) {
+        return BCA_ERROR_UNKNOWN;
+    }
+}
+
+static bool isBlockStream(bca_context* ctx)
+{
+    return ctx->mode == BCA_MODE_COMPRESS && ctx->compressor.getBlockSize() > 0;
+}
+
+bca_context* bca_create(void)
+{
+    return new (std::nothrow) bca_context();
+}
+
+void bca_free(bca_context* ctx)
+{
+    delete ctx;
+}
+
+const char* bca_error_string(int status)
+{
+    switch (status)
+    {
+        case BCA_OK: return "No error";
+        case BCA_ERROR_INVALID_ARGUMENT: return "Invalid argument";
+        case BCA_ERROR_OUT_OF_MEMORY: return "Out of memory";
+        case BCA_ERROR_OUTPUT_TOO_SMALL: return "Output buffer is too small";
+        case BCA_ERROR_INPUT_TOO_LARGE: return Compressor::getStatusString(COMPRESSOR_INPUT_TOO_LARGE);
+        case BCA_ERROR_INVALID_BIT_SIZE: return Compressor::getStatusString(COMPRESSOR_INVALID_BIT_SIZE);
+        case BCA_ERROR_BAD_TABLE: return Compressor::getStatusString(COMPRESSOR_BAD_TABLE);
+        case BCA_ERROR_BAD_CODES: return Compressor::getStatusString(COMPRESSOR_BAD_CODES);
+        case BCA_ERROR_BAD_LITERALS: return Compressor::getStatusString(COMPRESSOR_BAD_LITERALS);
+        case BCA_ERROR_BAD_BLOCK: return Compressor::getStatusString(COMPRESSOR_BAD_BLOCK);
+        case BCA_ERROR_UNKNOWN_ENGINE: return Compressor::getStatusString(COMPRESSOR_UNKNOWN_ENGINE);
+        case BCA_ERROR_STREAM_STATE: return "Stream call made out of order";
+        default: return "Unknown error";
+    }
+}
+
+int bca_set_block_size(bca_context* ctx, size_t blockSize)
+{
+    if (!ctx || blockSize > Compressor::MaxBlockSize)
+        return BCA_ERROR_INVALID_ARGUMENT;
+
+    // The legacy format has no engines to pick between
+    if (blockSize == 0 && (ctx->compressor.getEngine() != COMPRESSOR_ENGINE_AUTO || ctx->compressor.getDecodeSpeedBias() > 0))
+        return BCA_ERROR_INVALID_ARGUMENT;
+
+    if (ctx->state == STREAM_WRITING)
+        return BCA_ERROR_STREAM_STATE;
+
+    ctx->compressor.setBlockSize((unsigned)blockSize);
+    return BCA_OK;
+}
+
+int bca_set_decode_speed_bias(bca_context* ctx, double tolerance)
+{
+    if (!ctx || !(tolerance >= 0) || (tolerance > 0 && ctx->compressor.getBlockSize() == 0))
+        return BCA_ERROR_INVALID_ARGUMENT;
+
+    ctx->compressor.setDecodeSpeedBias(tolerance);
+    return BCA_OK;
+}
+
+int bca_set_engine(bca_context* ctx, int engine)
+{
+    if (!ctx || engine < BCA_ENGINE_AUTO || engine > BCA_ENGINE_TANS)
+        return BCA_ERROR_INVALID_ARGUMENT;
+
+    if (engine != BCA_ENGINE_AUTO && ctx->compressor.getBlockSize() == 0)
+        return BCA_ERROR_INVALID_ARGUMENT;
+
+    if (ctx->state == STREAM_WRITING)
+        return BCA_ERROR_STREAM_STATE;
+
+    switch (engine)
+    {
+        case BCA_ENGINE_FIXED_WIDTH: ctx->compressor.setEngine(COMPRESSOR_ENGINE_FIXED_WIDTH); break;
+        case BCA_ENGINE_STORED: ctx->compressor.setEngine(COMPRESSOR_ENGINE_STORED); break;
+        case BCA_ENGINE_TANS: ctx->compressor.setEngine(COMPRESSOR_ENGINE_TANS); break;
+        default: ctx->compressor.setEngine(COMPRESSOR_ENGINE_AUTO); break;
+    }
+
+    return BCA_OK;
+}
+
+size_t bca_compress_bound(bca_context* ctx, size_t srcLength)
+{
+    Compressor defaults;
+    Compressor& compressor = ctx ? ctx->compressor : defaults;
+
+    if (srcLength > 0xFFFFFFFFu || (compressor.getBlockSize() == 0 && srcLength > Compressor::MaxSingleBlockLength))
+        return 0;
+
+    unsigned long long bound = compressor.getCompressBound((unsigned)srcLength);
+    return bound > (size_t)-1 ? 0 : (size_t)bound;
+}
+
+int bca_decompressed_size(const void* src, size_t srcLength, size_t* dstLength)
+{
+    unsigned size;
+    int status;
+
+    if ((!src && srcLength > 0) || !dstLength)
+        return BCA_ERROR_INVALID_ARGUMENT;
+
+    status = Compressor::getDecompressedSize((void*)src, srcLength > 0xFFFFFFFFu ? 0xFFFFFFFFu : (unsigned)srcLength, size);
+
+    if (status == COMPRESSOR_OK)
+        *dstLength = size;
+
+    return toStatus(status);
+}
+
+int bca_compress(bca_context* ctx, const void* src, size_t srcLength,
+                 void* dst, size_t dstCapacity, size_t* dstLength)
+{
+    if (!ctx || (!src && srcLength > 0) || (!dst && dstCapacity > 0) || !dstLength)
+        return BCA_ERROR_INVALID_ARGUMENT;
+
+    // Compressing restarts the table that an open stream's blocks build on
+    if (ctx->state == STREAM_WRITING)
+        return BCA_ERROR_STREAM_STATE;
+
+    std::vector<unsigned char> result;
+    int status = runCodec(ctx, BCA_MODE_COMPRESS, src, srcLength, result);
+
+    if (status != BCA_OK)
+        return status;
+
+    return copyOut(result, dst, dstCapacity, dstLength);
+}
+
+int bca_decompress(bca_context* ctx, const void* src, size_t srcLength,
+                   void* dst, size_t dstCapacity, size_t* dstLength)
+{
+    if (!ctx || (!src && srcLength > 0) || (!dst && dstCapacity > 0) || !dstLength)
+        return BCA_ERROR_INVALID_ARGUMENT;
+
+    if (srcLength > 0xFFFFFFFFu)
+        return BCA_ERROR_INPUT_TOO_LARGE;
+
+    // Decoded in place, dst is checked against the size in the headers first
+    unsigned capacity = dstCapacity > 0xFFFFFFFFu ? 0xFFFFFFFFu : (unsigned)dstCapacity;
+    unsigned size = 0;
+    int status;
+
+    try {
+        status = toStatus(ctx->compressor.decompress((void*)src, (unsigned)srcLength, (unsigned char*)dst, capacity, size));
+    } catch (std::bad_alloc&) {
+        return BCA_ERROR_OUT_OF_MEMORY;
+    } catch (...) {
+        return BCA_ERROR_UNKNOWN;
+    }
+
+    if (status == BCA_OK || status == BCA_ERROR_OUTPUT_TOO_SMALL)
+        *dstLength = size;
+
+    return status;
+}
+
+int bca_stream_begin(bca_context* ctx, int mode)
+{
+    if (!ctx || (mode != BCA_MODE_COMPRESS && mode != BCA_MODE_DECOMPRESS))
+        return BCA_ERROR_INVALID_ARGUMENT;
+
+    ctx->mode = mode;
+    ctx->state = STREAM_IDLE;
+    ctx->input.clear();
+    ctx->output.clear();
+    ctx->outputPosition = 0;
+
+    try {
+        if (mode == BCA_MODE_COMPRESS && ctx->compressor.getBlockSize() > 0)
+            ctx->compressor.beginStream(ctx->output);
+    } catch (std::bad_alloc&) {
+        return BCA_ERROR_OUT_OF_MEMORY;
+    } catch (...) {
+        return BCA_ERROR_UNKNOWN;
+    }
+
+    ctx->state = STREAM_WRITING;
+    return BCA_OK;
+}
+
+int bca_stream_write(bca_context* ctx, const void* src, size_t srcLength)
+{
+    if (!ctx || (!src && srcLength > 0))
+        return BCA_ERROR_INVALID_ARGUMENT;
+
+    if (ctx->state != STREAM_WRITING)
+        return BCA_ERROR_STREAM_STATE;
+
+    try {
+        ctx->input.insert(ctx->input.end(), (const unsigned char*)src, (const unsigned char*)src + srcLength);
+
+        if (!isBlockStream(ctx))
+            return BCA_OK;
+
+        // Encode every full block that is known not to be the last one, the
+        // remainder waits for more input or bca_stream_finish
+        unsigned blockSize = ctx->compressor.getBlockSize();
+        size_t consumed = 0;
+
+        while (ctx->input.size() - consumed > blockSize)
+        {
+            int status = toStatus(ctx->compressor.compressBlock(ctx->input.data() + consumed, blockSize, false, ctx->output));
+
+            if (status != BCA_OK)
+                return status;
+
+            consumed += blockSize;
+        }
+
+        ctx->input.erase(ctx->input.begin(), ctx->input.begin() + consumed);
+    } catch (std::bad_alloc&) {
+        return BCA_ERROR_OUT_OF_MEMORY;
+    } catch (...) {
+        return BCA_ERROR_UNKNOWN;
+    }
+
+    return BCA_OK;
+}
+
+int bca_stream_finish(bca_context* ctx)
+{
+    if (!ctx)
+        return BCA_ERROR_INVALID_ARGUMENT;
+
+    if (ctx->state != STREAM_WRITING)
+        return BCA_ERROR_STREAM_STATE;
+
+    int status;
+
+    if (isBlockStream(ctx))
+    {
+        try {
+            status = toStatus(ctx->compressor.compressBlock(ctx->input.data(), ctx->input.size(), true, ctx->output));
+        } catch (std::bad_alloc&) {
+            status = BCA_ERROR_OUT_OF_MEMORY;
+        } catch (...) {
+            status = BCA_ERROR_UNKNOWN;
+        }
+    }
+    else
+    {
+        status = runCodec(ctx, ctx->mode, ctx->input.data(), ctx->input.size(), ctx->output);
+        ctx->outputPosition = 0;
+    }
+
+    std::vector<unsigned char>().swap(ctx->input);
+    ctx->state = status == BCA_OK ? STREAM_FINISHED : STREAM_IDLE;
+
+    return status;
+}
+
+int bca_stream_read(bca_context* ctx, void* dst, size_t dstCapacity, size_t* dstLength)
+{
+    if (!ctx || (!dst && dstCapacity > 0) || !dstLength)
+        return BCA_ERROR_INVALID_ARGUMENT;
+
+    if (ctx->state != STREAM_FINISHED && !(ctx->state == STREAM_WRITING && isBlockStream(ctx)))
+        return BCA_ERROR_STREAM_STATE;
+
+    size_t count = ctx->output.size() - ctx->outputPosition;
+
+    if (count > dstCapacity)
+        count = dstCapacity;
+
+    if (count > 0)
+        memcpy(dst, ctx->output.data() + ctx->outputPosition, count);
+
+    ctx->outputPosition += count;
+    *dstLength = count;
+
+    if (ctx->outputPosition == ctx->output.size())
+    {
+        ctx->output.clear();
+        ctx->outputPosition = 0;
+    }
+
+    return BCA_OK;
+}
+
+size_t bca_stream_pending(const bca_context* ctx)
+{
+    if (!ctx || ctx->state == STREAM_IDLE)
+        return 0;
+
+    return ctx->output.size() - ctx->outputPosition;
+}
+
+int bca_block_count(const void* src, size_t srcLength, size_t* count)
+{
+    unsigned blocks;
+    int status;
+
+    if ((!src && srcLength > 0) || !count)
+        return BCA_ERROR_INVALID_ARGUMENT;
+
+    if (srcLength > 0xFFFFFFFFu)
+        return BCA_ERROR_INPUT_TOO_LARGE;
+
+    status = Compressor::getBlockCount((void*)src, (unsigned)srcLength, blocks);
+
+    if (status == COMPRESSOR_OK)
+        *count = blocks;
+
+    return toStatus(status);
+}
+
+bca_cache* bca_cache_create(size_t byteBudget)
+{
+    try {
+        return new bca_cache(byteBudget);
+    } catch (...) {
+        return 0;
+    }
+}
+
+void bca_cache_free(bca_cache* cache)
+{
+    delete cache;
+}
+
+int bca_cache_read_block(bca_cache* cache, const char* file, const void* src, size_t srcLength,
+                         size_t block, void* dst, size_t dstCapacity, size_t* dstLength)
+{
+    if (!cache || !file || (!src && srcLength > 0) || (!dst && dstCapacity > 0) || !dstLength)
+        return BCA_ERROR_INVALID_ARGUMENT;
+
+    if (srcLength > 0xFFFFFFFFu)
+        return BCA_ERROR_INPUT_TOO_LARGE;
+
+    if (block > 0xFFFFFFFFu)
+        return BCA_ERROR_BAD_BLOCK;
+
+    try {
+        int status;
+        BlockCache::BlockData data = cache->cache.getBlock(file, (void*)src, (unsigned)srcLength, (unsigned)block, status);
+
+        if (!data)
+            return toStatus(status);
+
+        return copyOut(*data, dst, dstCapacity, dstLength);
+    } catch (std::bad_alloc&) {
+        return BCA_ERROR_OUT_OF_MEMORY;
+    } catch (...) {
+        return BCA_ERROR_UNKNOWN;
+    }
+}
+
+void bca_cache_invalidate(bca_cache* cache, const char* file)
+{
+    if (!cache || !file)
+        return;
+
+    // Only building the std::string can throw, then nothing was cached under it
+    try {
+        cache->cache.invalidate(file);
+    } catch (...) {
+    }
+}
+
+void bca_cache_stats(bca_cache* cache, unsigned long long* hits, unsigned long long* misses,
+                     unsigned long long* evictions, unsigned long long* cachedBytes)
+{
+    if (!cache)
+        return;
+
+    if (hits)
+        *hits = cache->cache.getHits();
+
+    if (misses)
+        *misses = cache->cache.getMisses();
+
+    if (evictions)
+        *evictions = cache->cache.getEvictions();
+
+    if (cachedBytes)
+        *cachedBytes = cache->cache.getCachedBytes();
+}
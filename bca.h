@@ -0,0 +1,167 @@
+#ifndef BCA_H
+#define BCA_H
+
+/*
+ * C interface to the compressor, meant to be built as libbca (static or shared).
+ * Every function returns a bca_status code; nothing here throws across the ABI.
+ * Define BCA_SHARED when building or linking the shared library and BCA_BUILD
+ * while compiling the library itself.
+ */
+
+#include <stddef.h>
+
+#if defined(BCA_SHARED)
+    #if defined(_WIN32)
+        #if defined(BCA_BUILD)
+            #define BCA_API __declspec(dllexport)
+        #else
+            #define BCA_API __declspec(dllimport)
+        #endif
+    #elif defined(__GNUC__)
+        #define BCA_API __attribute__((visibility("default")))
+    #else
+        #define BCA_API
+    #endif
+#else
+    #define BCA_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct bca_context bca_context;
+
+typedef enum bca_status
+{
+    BCA_OK = 0,
+    BCA_ERROR_INVALID_ARGUMENT,
+    BCA_ERROR_OUT_OF_MEMORY,
+    BCA_ERROR_OUTPUT_TOO_SMALL,
+    BCA_ERROR_INPUT_TOO_LARGE,
+    BCA_ERROR_INVALID_BIT_SIZE,
+    BCA_ERROR_BAD_TABLE,
+    BCA_ERROR_BAD_CODES,
+    BCA_ERROR_BAD_LITERALS,
+    BCA_ERROR_STREAM_STATE,
+    BCA_ERROR_BAD_BLOCK,
+    BCA_ERROR_UNKNOWN_ENGINE,
+    BCA_ERROR_UNKNOWN
+} bca_status;
+
+typedef enum bca_engine
+{
+    BCA_ENGINE_AUTO = 0,
+    BCA_ENGINE_FIXED_WIDTH,
+    BCA_ENGINE_STORED,
+    BCA_ENGINE_TANS
+} bca_engine;
+
+typedef enum bca_mode
+{
+    BCA_MODE_COMPRESS = 0,
+    BCA_MODE_DECOMPRESS
+} bca_mode;
+
+/* Context lifetime. A context is not thread-safe, use one per thread. */
+BCA_API bca_context* bca_create(void);
+BCA_API void bca_free(bca_context* ctx);
+
+/* Human readable description of a status code, never NULL. */
+BCA_API const char* bca_error_string(int status);
+
+/* Largest block size accepted by bca_set_block_size, 16 MiB - 1. */
+#define BCA_MAX_BLOCK_SIZE 0xFFFFFF
+
+/*
+ * Input is split into blocks of blockSize bytes (default 64 KiB, at most
+ * BCA_MAX_BLOCK_SIZE). A block size of 0 writes the legacy single-block format, which
+ * is limited to 16 MiB - 1 of input and has no engines or decode speed bias,
+ * so it is refused while either is set. Cannot be changed while streaming.
+ */
+BCA_API int bca_set_block_size(bca_context* ctx, size_t blockSize);
+
+/*
+ * Lets each block grow up to (1 + tolerance) times its smallest encoding when a
+ * larger encoding is cheaper to decode. 0 (the default) optimizes size only.
+ * Only 0 is accepted with a block size of 0.
+ */
+BCA_API int bca_set_decode_speed_bias(bca_context* ctx, double tolerance);
+
+/*
+ * Restricts every block to one bca_engine. BCA_ENGINE_AUTO (the default) picks
+ * per block between fixed-width codes, tANS and stored bytes. Only
+ * BCA_ENGINE_AUTO is accepted with a block size of 0.
+ */
+BCA_API int bca_set_engine(bca_context* ctx, int engine);
+
+/*
+ * Largest possible output of bca_compress for an input of srcLength bytes with
+ * the context's block size (or the default one when ctx is NULL).
+ */
+BCA_API size_t bca_compress_bound(bca_context* ctx, size_t srcLength);
+
+/* Original size stored in the header of a compressed buffer. */
+BCA_API int bca_decompressed_size(const void* src, size_t srcLength, size_t* dstLength);
+
+/*
+ * One-shot calls. dstLength receives the number of bytes written, or the number
+ * of bytes required when BCA_ERROR_OUTPUT_TOO_SMALL is returned. bca_compress
+ * returns BCA_ERROR_STREAM_STATE while a stream is open on the same context.
+ * bca_decompress decodes straight into dst, whose contents are undefined when
+ * it fails.
+ */
+BCA_API int bca_compress(bca_context* ctx, const void* src, size_t srcLength,
+                         void* dst, size_t dstCapacity, size_t* dstLength);
+BCA_API int bca_decompress(bca_context* ctx, const void* src, size_t srcLength,
+                           void* dst, size_t dstCapacity, size_t* dstLength);
+
+/*
+ * Streaming calls: begin, write input in any number of chunks, finish, then read
+ * the output back in chunks until bca_stream_pending returns 0. When compressing
+ * with a block size, finished blocks can already be read between writes; other
+ * modes stage the input inside the context until bca_stream_finish.
+ */
+BCA_API int bca_stream_begin(bca_context* ctx, int mode);
+BCA_API int bca_stream_write(bca_context* ctx, const void* src, size_t srcLength);
+BCA_API int bca_stream_finish(bca_context* ctx);
+BCA_API int bca_stream_read(bca_context* ctx, void* dst, size_t dstCapacity, size_t* dstLength);
+BCA_API size_t bca_stream_pending(const bca_context* ctx);
+
+/* Number of blocks in a compressed buffer, 1 for the legacy single-block format. */
+BCA_API int bca_block_count(const void* src, size_t srcLength, size_t* count);
+
+/*
+ * Cache of decompressed blocks for random access, safe to share between threads.
+ * Blocks are kept by (file, block number) along with an index of each file's
+ * blocks, which takes about 131 bytes per block plus the file name. Both count
+ * against byteBudget; indexes are evicted after every other block, and with a
+ * budget smaller than a file's index each miss walks that file again. A file name
+ * must keep referring to the same compressed bytes until it is passed to
+ * bca_cache_invalidate.
+ */
+typedef struct bca_cache bca_cache;
+
+BCA_API bca_cache* bca_cache_create(size_t byteBudget);
+BCA_API void bca_cache_free(bca_cache* cache);
+
+/*
+ * Copies block number block of src (the whole compressed file) to dst, decoding
+ * and caching it on a miss. dstLength works as in the one-shot calls.
+ */
+BCA_API int bca_cache_read_block(bca_cache* cache, const char* file, const void* src, size_t srcLength,
+                                 size_t block, void* dst, size_t dstCapacity, size_t* dstLength);
+BCA_API void bca_cache_invalidate(bca_cache* cache, const char* file);
+
+/*
+ * Counters since the cache was created, any of the pointers may be NULL.
+ * evictions counts blocks only, cachedBytes includes the indexes.
+ */
+BCA_API void bca_cache_stats(bca_cache* cache, unsigned long long* hits, unsigned long long* misses,
+                             unsigned long long* evictions, unsigned long long* cachedBytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BCA_H */
@@ -0,0 +1,264 @@
+// Micro-benchmark for BitStream, built on its own against BitStream.cpp:
+//     g++ -std=c++11 -O2 benchmark/BitStreamBenchmark.cpp BitStream.cpp -o bitstream_bench
+// Usage: bitstream_bench [symbols per run]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "../BitStream.h"
+
+#if defined(_MSC_VER)
+    #include <intrin.h>
+    #define HAS_CYCLE_COUNTER 1
+#elif defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+    #define HAS_CYCLE_COUNTER 1
+#else
+    #define HAS_CYCLE_COUNTER 0
+#endif
+
+#define UNALIGNED_OFFSET 3
+#define REPETITIONS 5
+
+struct Sample
+{
+    double nanoseconds;
+    double cycles;
+};
+
+static unsigned gSink = 0;
+
+static unsigned long long readCycles()
+{
+#if HAS_CYCLE_COUNTER
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// Runs the test REPETITIONS times and keeps the fastest one
+template <class Test>
+static Sample measure(Test test)
+{
+    Sample best = { -1, -1 };
+
+    for (int i = 0; i < REPETITIONS; i++)
+    {
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        unsigned long long startCycles = readCycles();
+
+        test();
+
+        unsigned long long cycles = readCycles() - startCycles;
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+        if (best.nanoseconds < 0 || elapsed.count() < best.nanoseconds)
+        {
+            best.nanoseconds = elapsed.count();
+            best.cycles = (double)cycles;
+        }
+    }
+
+    return best;
+}
+
+static void report(const char* name, int width, bool aligned, bool presized, Sample sample, unsigned symbols, double bytes)
+{
+    printf("%-18s %5d %-9s %-8s %10.3f", name, width, aligned ? "aligned" : "unaligned",
+           presized ? "presized" : "-", sample.nanoseconds / symbols);
+
+    if (HAS_CYCLE_COUNTER && bytes > 0)
+        printf(" %12.3f\n", sample.cycles / bytes);
+    else
+        printf(" %12s\n", "n/a");
+}
+
+static void prepare(BitStream& bs, bool aligned, bool presized, unsigned bytes)
+{
+    if (presized)
+        bs.reserve(bytes + 1);
+
+    if (!aligned)
+        bs.insert(0U, UNALIGNED_OFFSET);
+}
+
+static void benchmarkInsertBits(const std::vector<unsigned>& values, int width, bool aligned, bool presized)
+{
+    unsigned symbols = values.size();
+    double bytes = symbols * (double)width / 8;
+
+    Sample sample = measure([&]() {
+        BitStream bs;
+        prepare(bs, aligned, presized, (unsigned)bytes);
+
+        for (unsigned i = 0; i < symbols; i++)
+            bs.insert(values[i], width);
+
+        gSink += bs.getBitCount();
+    });
+
+    report("insert(bits)", width, aligned, presized, sample, symbols, bytes);
+}
+
+static void benchmarkInsertByte(const std::vector<unsigned>& values, bool aligned, bool presized)
+{
+    unsigned symbols = values.size();
+
+    Sample sample = measure([&]() {
+        BitStream bs;
+        prepare(bs, aligned, presized, symbols);
+
+        for (unsigned i = 0; i < symbols; i++)
+            bs.insert((unsigned char)values[i]);
+
+        gSink += bs.getBitCount();
+    });
+
+    report("insert(byte)", 8, aligned, presized, sample, symbols, symbols);
+}
+
+static void benchmarkInsertBuffer(const std::vector<unsigned char>& buffer, bool aligned, bool presized)
+{
+    unsigned symbols = buffer.size();
+
+    Sample sample = measure([&]() {
+        BitStream bs;
+        prepare(bs, aligned, presized, symbols);
+        bs.insert((void*)buffer.data(), symbols);
+        gSink += bs.getBitCount();
+    });
+
+    report("insert(buffer)", 8, aligned, presized, sample, symbols, symbols);
+}
+
+static void benchmarkReadBits(const std::vector<unsigned>& values, int width, bool aligned)
+{
+    unsigned symbols = values.size();
+    double bytes = symbols * (double)width / 8;
+    BitStream bs;
+
+    prepare(bs, aligned, false, (unsigned)bytes);
+
+    for (unsigned i = 0; i < symbols; i++)
+        bs.insert(values[i], width);
+
+    Sample sample = measure([&]() {
+        BitStream copy = bs;
+        unsigned char bits;
+
+        if (!aligned)
+            copy.skip_bits(UNALIGNED_OFFSET);
+
+        for (unsigned i = 0; i < symbols; i++)
+        {
+            copy.read_bits(bits, width);
+            gSink += bits;
+        }
+    });
+
+    report("read_bits", width, aligned, false, sample, symbols, bytes);
+}
+
+// Many short streams, so the reads regularly land on the unfinished mCurrentByte
+// (every width but 8 leaves a partial last byte). Includes copying each stream.
+static void benchmarkReadTail(unsigned symbols, int width)
+{
+    std::vector<BitStream> streams(symbols / 4 + 1);
+    unsigned perStream = (3 * 8 + width - 1) / width + 1;
+    double bytes = streams.size() * (perStream * (double)width / 8);
+
+    for (unsigned s = 0; s < streams.size(); s++)
+    {
+        for (unsigned i = 0; i < perStream; i++)
+            streams[s].insert(s + i, width);
+    }
+
+    Sample sample = measure([&]() {
+        unsigned char bits;
+
+        for (unsigned s = 0; s < streams.size(); s++)
+        {
+            BitStream copy = streams[s];
+
+            while (copy.canRead())
+            {
+                copy.read_bits(bits, width);
+                gSink += bits;
+            }
+        }
+    });
+
+    report("read_bits(tail)", width, true, false, sample, streams.size() * perStream, bytes);
+}
+
+static void benchmarkGetData(unsigned symbols, bool aligned)
+{
+    BitStream bs;
+    prepare(bs, aligned, false, symbols);
+
+    for (unsigned i = 0; i < symbols; i++)
+        bs.insert((unsigned char)i);
+
+    Sample sample = measure([&]() {
+        std::vector<unsigned char> data = bs.getData();
+        gSink += data.size();
+    });
+
+    report("getData", 8, aligned, false, sample, symbols, symbols);
+}
+
+int main(int argc, char* args[])
+{
+    unsigned symbols = argc > 1 ? (unsigned)atol(args[1]) : 1 << 22;
+    std::vector<unsigned> values(symbols);
+    std::vector<unsigned char> buffer(symbols);
+
+    if (symbols == 0)
+    {
+        printf("Invalid symbol count.\n");
+        return 1;
+    }
+
+    srand(1);
+
+    for (unsigned i = 0; i < symbols; i++)
+    {
+        values[i] = rand();
+        buffer[i] = (unsigned char)values[i];
+    }
+
+    printf("%u symbols per run, best of %d runs\n\n", symbols, REPETITIONS);
+    printf("%-18s %5s %-9s %-8s %10s %12s\n", "test", "width", "alignment", "sizing", "ns/symbol", "cycles/byte");
+
+    for (int width = 1; width <= 8; width++)
+    {
+        for (int aligned = 1; aligned >= 0; aligned--)
+        {
+            benchmarkInsertBits(values, width, aligned, false);
+            benchmarkInsertBits(values, width, aligned, true);
+        }
+    }
+
+    for (int aligned = 1; aligned >= 0; aligned--)
+    {
+        benchmarkInsertByte(values, aligned, false);
+        benchmarkInsertByte(values, aligned, true);
+        benchmarkInsertBuffer(buffer, aligned, false);
+        benchmarkInsertBuffer(buffer, aligned, true);
+    }
+
+    for (int width = 1; width <= 8; width++)
+    {
+        benchmarkReadBits(values, width, true);
+        benchmarkReadBits(values, width, false);
+        benchmarkReadTail(symbols, width);
+    }
+
+    benchmarkGetData(symbols, true);
+    benchmarkGetData(symbols, false);
+
+    printf("\n(checksum %u)\n", gSink);
+    return 0;
+}
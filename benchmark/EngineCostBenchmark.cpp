@@ -0,0 +1,134 @@
+// Measures the decode cost of each block engine, the numbers behind
+// Compressor::EngineCosts. Built on its own against the library sources:
+//     g++ -std=c++11 -O2 -pthread benchmark/EngineCostBenchmark.cpp Compressor.cpp BitStream.cpp TansCoder.cpp -o engine_cost_bench
+// Usage: engine_cost_bench [input bytes]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "../Compressor.h"
+
+#define REPETITIONS 5
+#define LARGE_BLOCK (1 << 20)
+#define SMALL_BLOCK 256
+
+struct Engine
+{
+    const char* name;
+    int engine;
+};
+
+static const Engine Engines[] =
+{
+    { "fixed", COMPRESSOR_ENGINE_FIXED_WIDTH },
+    { "stored", COMPRESSOR_ENGINE_STORED },
+    { "tans", COMPRESSOR_ENGINE_TANS }
+};
+
+static unsigned gSink = 0;
+
+// Bytes drawn uniformly from distinct values, at most 127 distinct values fit
+// a fixed-width table so the rest are escaped as literals
+static std::vector<unsigned char> makeInput(unsigned length, unsigned distinct)
+{
+    std::vector<unsigned char> data(length);
+
+    for (unsigned i = 0; i < length; i++)
+        data[i] = (unsigned char)(rand() % distinct);
+
+    return data;
+}
+
+static unsigned countLiterals(const std::vector<unsigned char>& data, unsigned distinct)
+{
+    unsigned literals = 0;
+
+    // Uniform input, so the table holds (close to) the first 127 values
+    for (unsigned i = 0; i < data.size(); i++)
+    {
+        if (distinct > 127 && data[i] >= 127)
+            literals++;
+    }
+
+    return literals;
+}
+
+// Fastest of REPETITIONS decodes, in nanoseconds
+static double measureDecode(const std::vector<unsigned char>& data, int engine, unsigned blockSize, unsigned& blocks)
+{
+    Compressor compressor;
+    std::vector<unsigned char> compressed, decoded;
+    double best = -1;
+
+    compressor.setEngine(engine);
+    compressor.setBlockSize(blockSize);
+
+    if (compressor.compress((void*)data.data(), data.size(), compressed) != COMPRESSOR_OK ||
+        Compressor::getBlockCount(compressed.data(), compressed.size(), blocks) != COMPRESSOR_OK)
+    {
+        printf("Compression failed.\n");
+        exit(1);
+    }
+
+    for (int i = 0; i < REPETITIONS; i++)
+    {
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+        if (compressor.decompress(compressed.data(), compressed.size(), decoded) != COMPRESSOR_OK || decoded != data)
+        {
+            printf("Decompression failed.\n");
+            exit(1);
+        }
+
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::high_resolution_clock::now() - start;
+        gSink += decoded[0];
+
+        if (best < 0 || elapsed.count() < best)
+            best = elapsed.count();
+    }
+
+    return best;
+}
+
+int main(int argc, char* args[])
+{
+    unsigned length = argc > 1 ? (unsigned)atol(args[1]) : 1 << 24;
+
+    if (length < LARGE_BLOCK)
+    {
+        printf("Input must be at least %u bytes.\n", LARGE_BLOCK);
+        return 1;
+    }
+
+    srand(1);
+
+    std::vector<unsigned char> covered = makeInput(length, 127);
+    std::vector<unsigned char> escaped = makeInput(length, 256);
+    unsigned literals = countLiterals(escaped, 256);
+
+    printf("%u bytes per run, best of %d runs\n\n", length, REPETITIONS);
+    printf("%-8s %12s %12s %12s\n", "engine", "perSymbol", "perBlock", "perLiteral");
+
+    for (unsigned e = 0; e < sizeof(Engines) / sizeof(Engines[0]); e++)
+    {
+        unsigned largeBlocks, smallBlocks, escapedBlocks;
+        double large = measureDecode(covered, Engines[e].engine, LARGE_BLOCK, largeBlocks);
+        double small = measureDecode(covered, Engines[e].engine, SMALL_BLOCK, smallBlocks);
+
+        // Block overhead includes reading that block's table, if it has one
+        printf("%-8s %12.3f %12.1f", Engines[e].name, large / length, (small - large) / (smallBlocks - largeBlocks));
+
+        if (Engines[e].engine == COMPRESSOR_ENGINE_FIXED_WIDTH)
+        {
+            double withLiterals = measureDecode(escaped, Engines[e].engine, LARGE_BLOCK, escapedBlocks);
+            printf(" %12.3f\n", (withLiterals - large) / literals);
+        }
+        else
+        {
+            printf(" %12s\n", "-");
+        }
+    }
+
+    return gSink == 0xFFFFFFFF;
+}
@@ -2,14 +2,15 @@
 #include <fstream>
 #include <cstdlib>
 #include <cstdio>
-#include "Compressor.h"
+#include <vector>
+#include "bca.h"
 #include "ArgumentParser.h"
 
 std::string getConsoleInput();
 void printHelp();
-bool parseArguments(int argc, char* args[], bool& compress, std::string& input, std::string& output);
+bool parseArguments(int argc, char* args[], bool& compress, std::string& input, std::string& output, long& blockSize, double& decodeSpeedBias, int& engine);
 
-void compressFile(std::string input, std::string output);
+void compressFile(std::string input, std::string output, long blockSize, double decodeSpeedBias, int engine);
 void decompressFile(std::string input, std::string output);
 
 int main(int argc, char* args[])
@@ -22,15 +23,18 @@ int main(int argc, char* args[])
 
     bool compress;
     std::string input, output;
+    long blockSize = -1;
+    double decodeSpeedBias = 0;
+    int engine = BCA_ENGINE_AUTO;
 
-    if (!parseArguments(argc, args, compress, input, output))
+    if (!parseArguments(argc, args, compress, input, output, blockSize, decodeSpeedBias, engine))
     {
         std::cout << "Invalid arguments.\n";
         return 0;
     }
 
     if (compress)
-        compressFile(input, output);
+        compressFile(input, output, blockSize, decodeSpeedBias, engine);
     else
         decompressFile(input, output);
 
@@ -57,10 +61,13 @@ void printHelp()
     std::cout << "Simple Compression Algorithm parameters:\n\n";
     std::cout << "-c input [output]\tCompresses file <input>, output is stored on file <output>, if provided, or in <input>.bca\n\n";
     std::cout << "-d input [output]\tDecompresses file in <input>, output is stored on file <output>, if provided, or asked in runtime\n\n";
+    std::cout << "-b size\t\t\tSplits the input in blocks of <size> bytes when compressing, 0 writes a single block\n\n";
+    std::cout << "-e engine\t\tEncodes every block with <engine>: auto (default), fixed, tans or stored\n\n";
+    std::cout << "--decode-speed-bias tolerance\tAllows blocks to grow by up to <tolerance> (0.05 = 5%) when that makes them faster to decode\n\n";
     std::cout << "-c overwrites -d and vice-versa, only last parameters are considered\n";
 }
 
-bool parseArguments(int argc, char* args[], bool& compress, std::string& input, std::string& output)
+bool parseArguments(int argc, char* args[], bool& compress, std::string& input, std::string& output, long& blockSize, double& decodeSpeedBias, int& engine)
 {
     ArgumentParser parser(argc, args);
     std::string arg;
@@ -110,16 +117,69 @@ bool parseArguments(int argc, char* args[], bool& compress, std::string& input,
                 else
                     output = input + ".bca";
             }
+            else if (arg == "-b")
+            {
+                arg = parser.getNextArgument();
+                char* end = 0;
+                blockSize = strtol(arg.c_str(), &end, 10);
+
+                if (arg.empty() || *end != '\0' || blockSize < 0)
+                {
+                    std::cout << "Invalid block size for -b.\n";
+                    return false;
+                }
+
+                if (blockSize > BCA_MAX_BLOCK_SIZE)
+                {
+                    std::cout << "Block size for -b can't be larger than " << BCA_MAX_BLOCK_SIZE << " bytes.\n";
+                    return false;
+                }
+            }
+            else if (arg == "-e")
+            {
+                arg = parser.getNextArgument();
+
+                if (arg == "auto")
+                    engine = BCA_ENGINE_AUTO;
+                else if (arg == "fixed")
+                    engine = BCA_ENGINE_FIXED_WIDTH;
+                else if (arg == "tans")
+                    engine = BCA_ENGINE_TANS;
+                else if (arg == "stored")
+                    engine = BCA_ENGINE_STORED;
+                else
+                {
+                    std::cout << "Invalid engine for -e.\n";
+                    return false;
+                }
+            }
+            else if (arg == "--decode-speed-bias")
+            {
+                arg = parser.getNextArgument();
+                char* end = 0;
+                decodeSpeedBias = strtod(arg.c_str(), &end);
+
+                if (arg.empty() || *end != '\0' || decodeSpeedBias < 0)
+                {
+                    std::cout << "Invalid tolerance for --decode-speed-bias.\n";
+                    return false;
+                }
+            }
         }
     }
 
+    // Engines and the decode speed bias only exist in the block format
+    if (blockSize == 0 && (engine != BCA_ENGINE_AUTO || decodeSpeedBias > 0))
+    {
+        std::cout << "-e and --decode-speed-bias can't be used with -b 0.\n";
+        return false;
+    }
+
     return hasCommand;
 }
 
-void compressFile(std::string input, std::string output)
+void compressFile(std::string input, std::string output, long blockSize, double decodeSpeedBias, int engine)
 {
-    Compressor compressor;
-
     std::fstream inputFile(input.c_str(), std::fstream::in | std::fstream::binary);
     std::fstream outputFile(output.c_str(), std::fstream::in);
     std::vector<unsigned char> fileData;
@@ -165,8 +225,37 @@ void compressFile(std::string input, std::string output)
     inputFile.close();
 
     unsigned originalFileSize = fileData.size();
+    std::vector<unsigned char> result;
+    size_t resultSize = 0;
+    bca_context* context = bca_create();
+    int status = BCA_OK;
+
+    if (blockSize >= 0)
+        status = bca_set_block_size(context, blockSize);
+
+    if (status == BCA_OK)
+        status = bca_set_decode_speed_bias(context, decodeSpeedBias);
+
+    if (status == BCA_OK)
+        status = bca_set_engine(context, engine);
+
+    if (status == BCA_OK)
+    {
+        result.resize(bca_compress_bound(context, fileData.size()));
+        status = bca_compress(context, fileData.data(), fileData.size(), result.data(), result.size(), &resultSize);
+    }
+
+    bca_free(context);
+
+    if (status != BCA_OK)
+    {
+        std::cout << "Couldn't compress file.\n";
+        std::cout << "More details: " << bca_error_string(status) << "\n";
+        return;
+    }
 
-    fileData = compressor.compress(fileData.data(), fileData.size());
+    result.resize(resultSize);
+    fileData.swap(result);
 
     outputFile.write((char*)fileData.data(), fileData.size());
     outputFile.close();
@@ -179,8 +268,6 @@ void compressFile(std::string input, std::string output)
 
 void decompressFile(std::string input, std::string output)
 {
-    Compressor compressor;
-
     if (output.empty())
     {
         std::cout << "Enter output path:\n\t> ";
@@ -238,18 +325,28 @@ void decompressFile(std::string input, std::string output)
     inputFile.close();
 
     unsigned originalFileSize = fileData.size();
-    bool success = false;
+    std::vector<unsigned char> result;
+    size_t resultSize = 0;
+    bca_context* context = bca_create();
+    int status = bca_decompressed_size(fileData.data(), fileData.size(), &resultSize);
 
-    try {
-        fileData = compressor.decompress(fileData.data(), fileData.size());
-        success = true;
-    } catch (std::string& excep) {
-        std::cout << "Couldn't decompress file.\n";
-        std::cout << "More details: " << excep << "\n";
+    if (status == BCA_OK)
+    {
+        result.resize(resultSize);
+        status = bca_decompress(context, fileData.data(), fileData.size(), result.data(), result.size(), &resultSize);
     }
 
-    if (!success)
+    bca_free(context);
+
+    if (status != BCA_OK)
+    {
+        std::cout << "Couldn't decompress file.\n";
+        std::cout << "More details: " << bca_error_string(status) << "\n";
         return;
+    }
+
+    result.resize(resultSize);
+    fileData.swap(result);
 
     outputFile.write((char*)fileData.data(), fileData.size());
     outputFile.close();
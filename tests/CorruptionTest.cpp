@@ -0,0 +1,133 @@
+// Feeds damaged compressed data to every decoding entry point. Flipped bits may
+// still decode to something, but never past the size the headers announce, and
+// truncated files and unknown stream versions must be refused. Worth running
+// under -fsanitize=address,undefined as well.
+// Usage: corruption_test [iterations]
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "bca.h"
+#include "BlockCache.h"
+#include "Compressor.h"
+
+#define MAX_INPUT 3000
+#define MAX_FLIPS 4
+#define MAX_BLOCKS_READ 5
+
+static int gFailures = 0;
+
+static void check(bool condition, const char* what, int iteration)
+{
+    if (!condition)
+    {
+        printf("FAILED: %s (iteration %d)\n", what, iteration);
+        gFailures++;
+    }
+}
+
+static std::vector<unsigned char> makeCompressed(unsigned& blockSize)
+{
+    unsigned length = rand() % MAX_INPUT;
+    unsigned alphabet = 1 + rand() % 256;
+    std::vector<unsigned char> data(length), compressed;
+    Compressor compressor;
+
+    for (unsigned i = 0; i < length; i++)
+        data[i] = (unsigned char)(rand() % alphabet);
+
+    // The legacy format takes no engine
+    blockSize = rand() % 2 ? 0 : 1 + rand() % 1000;
+    compressor.setBlockSize(blockSize);
+
+    if (blockSize > 0)
+        compressor.setEngine(rand() % 4);
+
+    compressor.compress(data.data(), length, compressed);
+    return compressed;
+}
+
+// Decodes through every entry point, the damaged data stays in its own
+// allocation so reads past it are caught by the sanitizers
+static void decodeAll(const std::vector<unsigned char>& damaged, int iteration)
+{
+    std::vector<unsigned char> buffer(damaged), result, block;
+    Compressor compressor;
+    unsigned size, count;
+
+    int sizeStatus = Compressor::getDecompressedSize(buffer.data(), buffer.size(), size);
+    int status = compressor.decompress(buffer.data(), buffer.size(), result);
+
+    check(status != COMPRESSOR_OK || (sizeStatus == COMPRESSOR_OK && result.size() == size), "decoded size matches the headers", iteration);
+
+    if (Compressor::getBlockCount(buffer.data(), buffer.size(), count) == COMPRESSOR_OK)
+    {
+        for (unsigned b = 0; b < count && b < MAX_BLOCKS_READ; b++)
+            compressor.decompressBlock(buffer.data(), buffer.size(), b, block);
+    }
+
+    BlockCache cache(1 << 16);
+    cache.getBlock("damaged", buffer.data(), buffer.size(), 0, status);
+
+    // Exactly the announced size, so an overrun writes past the allocation
+    if (sizeStatus == COMPRESSOR_OK)
+    {
+        bca_context* context = bca_create();
+        std::vector<unsigned char> out(size);
+        size_t outLength;
+
+        status = bca_decompress(context, buffer.data(), buffer.size(), out.data(), out.size(), &outLength);
+        check(status != BCA_OK || outLength == size, "bca_decompress size", iteration);
+        bca_free(context);
+    }
+}
+
+int main(int argc, char* args[])
+{
+    int iterations = argc > 1 ? atoi(args[1]) : 5000;
+
+    srand(11);
+
+    for (int i = 0; i < iterations; i++)
+    {
+        unsigned blockSize;
+        std::vector<unsigned char> compressed = makeCompressed(blockSize);
+        std::vector<unsigned char> damaged(compressed), result;
+        Compressor compressor;
+        unsigned size, count;
+
+        int flips = 1 + rand() % MAX_FLIPS;
+
+        for (int f = 0; f < flips; f++)
+            damaged[rand() % damaged.size()] ^= 1 << (rand() % 8);
+
+        decodeAll(damaged, i);
+
+        // Every block format file ends with the last block flag set, so any
+        // prefix of it is missing a block or part of one
+        if (blockSize > 0)
+        {
+            std::vector<unsigned char> truncated(compressed.begin(), compressed.begin() + rand() % compressed.size());
+
+            check(compressor.decompress(truncated.data(), truncated.size(), result) != COMPRESSOR_OK, "truncated file refused", i);
+            decodeAll(truncated, i);
+
+            // Only version 2 of the block format exists
+            std::vector<unsigned char> versioned(compressed);
+            versioned[2] ^= 1 + rand() % 255;
+
+            check(Compressor::getDecompressedSize(versioned.data(), versioned.size(), size) == COMPRESSOR_BAD_BLOCK, "unknown version size", i);
+            check(Compressor::getBlockCount(versioned.data(), versioned.size(), count) == COMPRESSOR_BAD_BLOCK, "unknown version block count", i);
+            check(compressor.decompress(versioned.data(), versioned.size(), result) == COMPRESSOR_BAD_BLOCK, "unknown version refused", i);
+        }
+    }
+
+    if (gFailures > 0)
+    {
+        printf("%d checks failed.\n", gFailures);
+        return 1;
+    }
+
+    printf("%d damaged files handled.\n", iterations);
+    return 0;
+}
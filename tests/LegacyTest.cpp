@@ -0,0 +1,118 @@
+// Decodes files written by the original single-block encoder. tests/data holds
+// pairs of legacy<N>.raw inputs and the legacy<N>.bca files the baseline encoder
+// produced for them, these must keep decoding byte for byte.
+// Usage: legacy_test data-directory
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "bca.h"
+#include "BlockCache.h"
+#include "Compressor.h"
+
+#define FIXTURES 6
+
+static int gFailures = 0;
+
+static void check(bool condition, const char* what, int fixture)
+{
+    if (!condition)
+    {
+        printf("FAILED: %s (legacy%d)\n", what, fixture);
+        gFailures++;
+    }
+}
+
+static bool readFile(const std::string& path, std::vector<unsigned char>& data)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    unsigned char buffer[4096];
+    size_t read;
+
+    if (!file)
+        return false;
+
+    data.clear();
+
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        data.insert(data.end(), buffer, buffer + read);
+
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char* args[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: legacy_test data-directory\n");
+        return 1;
+    }
+
+    for (int i = 0; i < FIXTURES; i++)
+    {
+        std::vector<unsigned char> raw, encoded, decoded;
+        char name[32];
+
+        sprintf(name, "/legacy%d.raw", i);
+
+        if (!readFile(args[1] + std::string(name), raw))
+        {
+            printf("Couldn't read %s%s\n", args[1], name);
+            return 1;
+        }
+
+        sprintf(name, "/legacy%d.bca", i);
+
+        if (!readFile(args[1] + std::string(name), encoded))
+        {
+            printf("Couldn't read %s%s\n", args[1], name);
+            return 1;
+        }
+
+        Compressor compressor;
+        unsigned size, count;
+
+        check(Compressor::getDecompressedSize(encoded.data(), encoded.size(), size) == COMPRESSOR_OK && size == raw.size(), "decompressed size", i);
+        check(Compressor::getBlockCount(encoded.data(), encoded.size(), count) == COMPRESSOR_OK && count == 1, "block count", i);
+        check(compressor.decompress(encoded.data(), encoded.size(), decoded) == COMPRESSOR_OK && decoded == raw, "decompress", i);
+        check(compressor.decompressBlock(encoded.data(), encoded.size(), 0, decoded) == COMPRESSOR_OK && decoded == raw, "decompressBlock", i);
+
+        // The C API decodes into the caller's buffer, which must be large enough
+        bca_context* context = bca_create();
+        std::vector<unsigned char> out(raw.size() + 1);
+        size_t outLength = 0;
+
+        check(bca_decompress(context, encoded.data(), encoded.size(), out.data(), out.size(), &outLength) == BCA_OK &&
+              outLength == raw.size() && std::equal(raw.begin(), raw.end(), out.begin()), "bca_decompress", i);
+
+        if (!raw.empty())
+        {
+            check(bca_decompress(context, encoded.data(), encoded.size(), out.data(), raw.size() - 1, &outLength) == BCA_ERROR_OUTPUT_TOO_SMALL &&
+                  outLength == raw.size(), "bca_decompress into a short buffer", i);
+        }
+
+        bca_free(context);
+
+        // The legacy encoder is still reachable through a block size of 0
+        std::vector<unsigned char> reencoded;
+        compressor.setBlockSize(0);
+        check(compressor.compress(raw.data(), raw.size(), reencoded) == COMPRESSOR_OK &&
+              compressor.decompress(reencoded.data(), reencoded.size(), decoded) == COMPRESSOR_OK && decoded == raw, "legacy round trip", i);
+
+        BlockCache cache(1 << 20);
+        int status;
+        BlockCache::BlockData block = cache.getBlock("legacy", encoded.data(), encoded.size(), 0, status);
+        check(status == COMPRESSOR_OK && block && *block == raw, "cached block", i);
+    }
+
+    if (gFailures > 0)
+    {
+        printf("%d checks failed.\n", gFailures);
+        return 1;
+    }
+
+    printf("All legacy fixtures decoded.\n");
+    return 0;
+}
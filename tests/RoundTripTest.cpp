@@ -0,0 +1,211 @@
+// Compresses generated inputs with every engine, decode speed bias and a range
+// of block sizes, then checks the output decodes back whole and block by block.
+// The block headers are read back to check the forced engine was used and that
+// the fixed-width engine wrote all three table modes.
+// Usage: round_trip_test
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "bca.h"
+#include "Compressor.h"
+
+#define SEGMENT_LENGTH 20000
+
+// Block header fields as laid out in the file, see Compressor::parseBlockHeader
+#define HEADER_BYTES 7
+#define HEADER_ENGINE_FIXED_WIDTH 0
+#define HEADER_ENGINE_STORED 1
+#define HEADER_ENGINE_TANS 2
+#define HEADER_TABLE_MODES 3
+
+struct Input
+{
+    const char* name;
+    std::vector<unsigned char> data;
+};
+
+static const int Engines[] = { BCA_ENGINE_AUTO, BCA_ENGINE_FIXED_WIDTH, BCA_ENGINE_STORED, BCA_ENGINE_TANS };
+static const double Biases[] = { 0, 0.05, 1.0 };
+static const size_t BlockSizes[] = { 0, 1, 100, 4096, 65536, BCA_MAX_BLOCK_SIZE };
+
+static int gFailures = 0;
+static unsigned gTableModes[HEADER_TABLE_MODES] = { 0 };
+
+static void check(bool condition, const char* what, const char* input, size_t blockSize, int engine, double bias)
+{
+    if (!condition)
+    {
+        printf("FAILED: %s (%s, block size %u, engine %d, bias %g)\n", what, input, (unsigned)blockSize, engine, bias);
+        gFailures++;
+    }
+}
+
+// Segments drawn from shifting alphabets, so consecutive blocks can reuse the
+// table, patch a few slots of it or need a new one
+static std::vector<unsigned char> makeSegmented()
+{
+    static const unsigned Alphabets[][2] = { { 'a', 10 }, { 'a', 10 }, { 'a', 14 }, { 128, 60 }, { 0, 256 }, { 'a', 10 } };
+    std::vector<unsigned char> data;
+
+    for (unsigned s = 0; s < sizeof(Alphabets) / sizeof(Alphabets[0]); s++)
+    {
+        for (unsigned i = 0; i < SEGMENT_LENGTH; i++)
+        {
+            // Skewed towards the start of the alphabet, like text
+            unsigned value = rand() % Alphabets[s][1];
+            data.push_back((unsigned char)(Alphabets[s][0] + (rand() % 2 ? value / 4 : value)));
+        }
+    }
+
+    return data;
+}
+
+static std::vector<unsigned char> makeRandom(unsigned length)
+{
+    std::vector<unsigned char> data(length);
+
+    for (unsigned i = 0; i < length; i++)
+        data[i] = (unsigned char)rand();
+
+    return data;
+}
+
+static int readHeaderEngine(const std::vector<unsigned char>& compressed, unsigned offset, unsigned& tableMode)
+{
+    unsigned long long fields = 0;
+
+    for (unsigned i = 0; i < HEADER_BYTES; i++)
+        fields = (fields << 8) | compressed[offset + i];
+
+    tableMode = (fields >> 24) & 3;
+    return (fields >> 29) & 3;
+}
+
+static void checkBlocks(const std::vector<unsigned char>& compressed, const Input& input, size_t blockSize, int engine, double bias)
+{
+    static const int HeaderEngines[] = { -1, HEADER_ENGINE_FIXED_WIDTH, HEADER_ENGINE_STORED, HEADER_ENGINE_TANS };
+    std::vector<Compressor::BlockPosition> index;
+    std::vector<unsigned char> joined, block;
+    Compressor compressor;
+
+    if (Compressor::indexBlocks((void*)compressed.data(), compressed.size(), index) != COMPRESSOR_OK)
+    {
+        check(false, "indexBlocks", input.name, blockSize, engine, bias);
+        return;
+    }
+
+    // Decoded back to front, each block must only need its own position
+    for (size_t b = index.size(); b-- > 0;)
+    {
+        if (compressor.decompressBlock((void*)compressed.data(), compressed.size(), index[b], block) != COMPRESSOR_OK)
+        {
+            check(false, "decompressBlock", input.name, blockSize, engine, bias);
+            return;
+        }
+
+        joined.insert(joined.begin(), block.begin(), block.end());
+
+        if (blockSize == 0)
+            continue;
+
+        unsigned tableMode;
+        int headerEngine = readHeaderEngine(compressed, index[b].offset, tableMode);
+
+        // An empty input has no symbols to build a tANS table from, it's stored
+        if (engine != BCA_ENGINE_AUTO && !(engine == BCA_ENGINE_TANS && input.data.empty()))
+            check(headerEngine == HeaderEngines[engine], "forced engine", input.name, blockSize, engine, bias);
+
+        if (headerEngine == HEADER_ENGINE_FIXED_WIDTH && tableMode < HEADER_TABLE_MODES)
+            gTableModes[tableMode]++;
+    }
+
+    check(joined == input.data, "blocks joined", input.name, blockSize, engine, bias);
+}
+
+static void roundTrip(const Input& input, size_t blockSize, int engine, double bias)
+{
+    bca_context* context = bca_create();
+
+    // The legacy format only knows one encoding
+    if (bca_set_block_size(context, blockSize) != BCA_OK ||
+        bca_set_engine(context, engine) != BCA_OK ||
+        bca_set_decode_speed_bias(context, bias) != BCA_OK)
+    {
+        check(blockSize == 0 && (engine != BCA_ENGINE_AUTO || bias > 0), "settings", input.name, blockSize, engine, bias);
+        bca_free(context);
+        return;
+    }
+
+    size_t bound = bca_compress_bound(context, input.data.size());
+    std::vector<unsigned char> compressed(bound);
+    std::vector<unsigned char> decoded(input.data.size());
+    size_t compressedLength, decodedLength, size;
+
+    if (bca_compress(context, input.data.data(), input.data.size(), compressed.data(), compressed.size(), &compressedLength) != BCA_OK)
+    {
+        check(false, "bca_compress", input.name, blockSize, engine, bias);
+        bca_free(context);
+        return;
+    }
+
+    compressed.resize(compressedLength);
+
+    check(bca_decompressed_size(compressed.data(), compressed.size(), &size) == BCA_OK && size == input.data.size(),
+          "bca_decompressed_size", input.name, blockSize, engine, bias);
+    check(bca_decompress(context, compressed.data(), compressed.size(), decoded.data(), decoded.size(), &decodedLength) == BCA_OK &&
+          decodedLength == input.data.size() && decoded == input.data, "bca_decompress", input.name, blockSize, engine, bias);
+
+    checkBlocks(compressed, input, blockSize, engine, bias);
+    bca_free(context);
+}
+
+int main()
+{
+    srand(1);
+
+    Input inputs[] =
+    {
+        { "empty", std::vector<unsigned char>() },
+        { "one byte", std::vector<unsigned char>(1, 'x') },
+        { "run", std::vector<unsigned char>(70000, 'x') },
+        { "segmented", makeSegmented() },
+        { "random", makeRandom(100000) }
+    };
+
+    for (unsigned i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++)
+    {
+        for (unsigned s = 0; s < sizeof(BlockSizes) / sizeof(BlockSizes[0]); s++)
+        {
+            // One block per byte is only worth it on the small inputs
+            if (BlockSizes[s] == 1 && inputs[i].data.size() > 1000)
+                continue;
+
+            for (unsigned e = 0; e < sizeof(Engines) / sizeof(Engines[0]); e++)
+            {
+                for (unsigned b = 0; b < sizeof(Biases) / sizeof(Biases[0]); b++)
+                    roundTrip(inputs[i], BlockSizes[s], Engines[e], Biases[b]);
+            }
+        }
+    }
+
+    printf("Fixed-width table modes: %u new, %u reused, %u patched\n", gTableModes[0], gTableModes[1], gTableModes[2]);
+
+    for (unsigned m = 0; m < HEADER_TABLE_MODES; m++)
+    {
+        if (gTableModes[m] == 0)
+        {
+            printf("FAILED: table mode %u never written\n", m);
+            gFailures++;
+        }
+    }
+
+    if (gFailures > 0)
+    {
+        printf("%d checks failed.\n", gFailures);
+        return 1;
+    }
+
+    printf("All round trips passed.\n");
+    return 0;
+}
@@ -0,0 +1,149 @@
+// Streams inputs through a context in uneven chunks, reading the output back
+// between writes, and checks the result is byte for byte the one-shot output.
+// Decompressing goes through the stream calls too.
+// Usage: stream_test
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "bca.h"
+
+#define INPUT_LENGTH 300000
+#define MAX_CHUNK 50000
+#define READ_CHUNK 777
+
+static const int Engines[] = { BCA_ENGINE_AUTO, BCA_ENGINE_FIXED_WIDTH, BCA_ENGINE_STORED, BCA_ENGINE_TANS };
+static const double Biases[] = { 0, 0.05 };
+static const size_t BlockSizes[] = { 0, 100, 4096, 65536 };
+
+static int gFailures = 0;
+
+static void check(bool condition, const char* what, size_t blockSize, int engine, double bias)
+{
+    if (!condition)
+    {
+        printf("FAILED: %s (block size %u, engine %d, bias %g)\n", what, (unsigned)blockSize, engine, bias);
+        gFailures++;
+    }
+}
+
+// Text-like bytes whose alphabet drifts along the input, so the fixed-width
+// table changes between blocks
+static std::vector<unsigned char> makeInput()
+{
+    std::vector<unsigned char> data(INPUT_LENGTH);
+
+    for (unsigned i = 0; i < INPUT_LENGTH; i++)
+    {
+        unsigned alphabet = 8 + (i / 10000) % 40;
+        data[i] = (unsigned char)('0' + rand() % alphabet / (1 + rand() % 3));
+    }
+
+    return data;
+}
+
+static int drain(bca_context* context, std::vector<unsigned char>& output)
+{
+    unsigned char buffer[READ_CHUNK];
+    size_t read;
+
+    while (bca_stream_pending(context) > 0)
+    {
+        int status = bca_stream_read(context, buffer, sizeof(buffer), &read);
+
+        if (status != BCA_OK)
+            return status;
+
+        output.insert(output.end(), buffer, buffer + read);
+    }
+
+    return BCA_OK;
+}
+
+static int stream(bca_context* context, int mode, const std::vector<unsigned char>& input, std::vector<unsigned char>& output)
+{
+    size_t position = 0;
+    int status = bca_stream_begin(context, mode);
+
+    output.clear();
+
+    while (status == BCA_OK && position < input.size())
+    {
+        size_t chunk = std::min<size_t>(input.size() - position, 1 + rand() % MAX_CHUNK);
+
+        status = bca_stream_write(context, input.data() + position, chunk);
+        position += chunk;
+
+        if (status == BCA_OK)
+            status = drain(context, output);
+    }
+
+    if (status == BCA_OK)
+        status = bca_stream_finish(context);
+
+    if (status == BCA_OK)
+        status = drain(context, output);
+
+    return status;
+}
+
+static void compare(const std::vector<unsigned char>& input, size_t blockSize, int engine, double bias)
+{
+    bca_context* context = bca_create();
+
+    if (bca_set_block_size(context, blockSize) != BCA_OK ||
+        bca_set_engine(context, engine) != BCA_OK ||
+        bca_set_decode_speed_bias(context, bias) != BCA_OK)
+    {
+        bca_free(context);
+        return;
+    }
+
+    std::vector<unsigned char> oneShot(bca_compress_bound(context, input.size()));
+    std::vector<unsigned char> streamed, decoded;
+    size_t length;
+
+    check(bca_compress(context, input.data(), input.size(), oneShot.data(), oneShot.size(), &length) == BCA_OK, "bca_compress", blockSize, engine, bias);
+    oneShot.resize(length);
+
+    // Twice on the same context, the first stream must leave nothing behind
+    for (int pass = 0; pass < 2; pass++)
+    {
+        check(stream(context, BCA_MODE_COMPRESS, input, streamed) == BCA_OK && streamed == oneShot, "streamed compress", blockSize, engine, bias);
+        check(stream(context, BCA_MODE_DECOMPRESS, streamed, decoded) == BCA_OK && decoded == input, "streamed decompress", blockSize, engine, bias);
+    }
+
+    // Settings are locked and one-shot compression refused while a stream is open
+    check(bca_stream_begin(context, BCA_MODE_COMPRESS) == BCA_OK, "bca_stream_begin", blockSize, engine, bias);
+    check(bca_set_block_size(context, 4096) == BCA_ERROR_STREAM_STATE, "bca_set_block_size while streaming", blockSize, engine, bias);
+    check(bca_compress(context, input.data(), input.size(), oneShot.data(), oneShot.size(), &length) == BCA_ERROR_STREAM_STATE,
+          "bca_compress while streaming", blockSize, engine, bias);
+
+    bca_free(context);
+}
+
+int main()
+{
+    srand(1);
+
+    std::vector<unsigned char> input = makeInput();
+
+    for (unsigned s = 0; s < sizeof(BlockSizes) / sizeof(BlockSizes[0]); s++)
+    {
+        for (unsigned e = 0; e < sizeof(Engines) / sizeof(Engines[0]); e++)
+        {
+            for (unsigned b = 0; b < sizeof(Biases) / sizeof(Biases[0]); b++)
+                compare(input, BlockSizes[s], Engines[e], Biases[b]);
+        }
+    }
+
+    if (gFailures > 0)
+    {
+        printf("%d checks failed.\n", gFailures);
+        return 1;
+    }
+
+    printf("Streamed output matched the one-shot output.\n");
+    return 0;
+}